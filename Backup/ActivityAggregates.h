@@ -0,0 +1,326 @@
+// ActivityAggregates.h
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "CsvFormat.h"
+#include "SegmentSink.h"
+#include "StringPool.h"
+#include "Utf8.h"
+
+// Running totals per local day, by category and by process, kept up to date
+// as segments are logged so summaries never have to rescan the log. A
+// segment that crosses midnight is split between the two days.
+//
+// The totals are persisted to a small side file next to the log:
+//
+//   PC_ActivityLog_Totals.csv
+//   Day,Kind,Name,Seconds,Segments,LongestSeconds
+//   20240521,Category,"Development",11520,84,2710
+//   20240521,Process,"devenv.exe",9300,61,2710
+//
+// One thread adds segments (AggregatesSink's); any thread may query.
+class ActivityAggregates {
+public:
+    struct Totals {
+        int64_t seconds = 0;
+        uint32_t segments = 0;
+        int64_t longest = 0;    // longest single segment, in seconds
+    };
+
+    enum class Kind { Category, Process };
+
+private:
+    struct Day {
+        std::unordered_map<uint32_t, Totals> categories;
+        std::unordered_map<uint32_t, Totals> processes;
+    };
+
+    std::string path;
+    std::map<int32_t, Day> days;     // keyed by YYYYMMDD
+    bool dirty = false;
+    mutable std::mutex mutex;
+
+    // UTF-8 names, indexed by the IDs used in days; guarded by mutex
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> nameIds;
+
+    // Adding thread only: pool ID -> name ID + 1 (0 = not seen yet)
+    std::vector<uint32_t> poolToName;
+    std::string scratch;
+
+    // Adding thread only: [dayFrom, dayUntil) is the local day dayKey
+    time_t dayFrom = 0;
+    time_t dayUntil = 0;
+    int32_t dayKey = 0;
+
+    uint32_t nameId(const std::string& name) {
+        auto it = nameIds.find(name);
+        if (it != nameIds.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.push_back(name);
+        nameIds.emplace(name, id);
+        return id;
+    }
+
+    uint32_t nameFor(uint32_t poolId, const StringPool& pool) {
+        if (poolId >= poolToName.size()) {
+            poolToName.resize(poolId + 1, 0);
+        }
+        if (poolToName[poolId] == 0) {
+            assignUtf8(scratch, pool.get(poolId));
+            poolToName[poolId] = nameId(scratch) + 1;
+        }
+        return poolToName[poolId] - 1;
+    }
+
+    // Works out the local day containing time; mktime on local midnight
+    // keeps the bounds right on DST change days
+    void enterDay(time_t time) {
+        struct tm local;
+        if (localtime_s(&local, &time) != 0) {
+            dayKey = 0;
+            dayFrom = time;
+            dayUntil = time + 1;
+            return;
+        }
+        dayKey = keyOf(local);
+        local.tm_hour = local.tm_min = local.tm_sec = 0;
+        local.tm_isdst = -1;
+        dayFrom = mktime(&local);
+        local.tm_mday++;
+        local.tm_isdst = -1;
+        dayUntil = mktime(&local);
+        if (dayFrom > time || dayUntil <= time) {
+            dayFrom = time;
+            dayUntil = time + 1;
+        }
+    }
+
+    static int32_t keyOf(const struct tm& local) {
+        return (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday;
+    }
+
+    static void accumulate(Totals& totals, int64_t seconds) {
+        totals.seconds += seconds;
+        totals.segments++;
+        if (seconds > totals.longest) totals.longest = seconds;
+    }
+
+    static void merge(Totals& into, const Totals& from) {
+        into.seconds += from.seconds;
+        into.segments += from.segments;
+        if (from.longest > into.longest) into.longest = from.longest;
+    }
+
+    void appendRows(std::string& text, int32_t day, const char* kind,
+                    const std::unordered_map<uint32_t, Totals>& totals) const {
+        for (const auto& entry : totals) {
+            char numbers[80];
+            snprintf(numbers, sizeof(numbers), "%d,%s,", day, kind);
+            text += numbers;
+            appendCsvQuoted(text, names[entry.first]);
+            snprintf(numbers, sizeof(numbers), ",%lld,%u,%lld\n",
+                     static_cast<long long>(entry.second.seconds), entry.second.segments,
+                     static_cast<long long>(entry.second.longest));
+            text += numbers;
+        }
+    }
+
+public:
+    // Today's key, and the key of the Monday that starts this week
+    static int32_t todayKey() {
+        time_t now = time(nullptr);
+        struct tm local;
+        if (localtime_s(&local, &now) != 0) return 0;
+        return keyOf(local);
+    }
+
+    static int32_t weekStartKey() {
+        time_t now = time(nullptr);
+        struct tm local;
+        if (localtime_s(&local, &now) != 0) return 0;
+        local.tm_mday -= (local.tm_wday + 6) % 7;
+        local.tm_hour = 12;
+        local.tm_isdst = -1;
+        time_t monday = mktime(&local);
+        if (monday == -1 || localtime_s(&local, &monday) != 0) return 0;
+        return keyOf(local);
+    }
+
+    // Replaces the current totals with the side file's, if there is one
+    void load(const std::string& totalsPath) {
+        std::lock_guard<std::mutex> lock(mutex);
+        path = totalsPath;
+        days.clear();
+
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line); // header
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields = splitCsvLine(line);
+            if (fields.size() < 6) continue;
+            int32_t day = static_cast<int32_t>(std::strtol(fields[0].c_str(), nullptr, 10));
+            if (day <= 0) continue;
+
+            Totals totals;
+            totals.seconds = std::strtoll(fields[3].c_str(), nullptr, 10);
+            totals.segments = static_cast<uint32_t>(std::strtoul(fields[4].c_str(), nullptr, 10));
+            totals.longest = std::strtoll(fields[5].c_str(), nullptr, 10);
+
+            Day& entry = days[day];
+            uint32_t name = nameId(fields[2]);
+            merge(fields[1] == "Process" ? entry.processes[name] : entry.categories[name], totals);
+        }
+        dirty = false;
+    }
+
+    // Adding thread. Process Empty (e.g. an Inactive segment) counts only
+    // towards its category.
+    void add(time_t start, time_t end, uint32_t process, uint32_t category, const StringPool& pool) {
+        if (end <= start) return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t categoryName = nameFor(category, pool);
+        uint32_t processName = (process != StringPool::Empty) ? nameFor(process, pool) : 0;
+        while (start < end) {
+            if (start < dayFrom || start >= dayUntil) {
+                enterDay(start);
+            }
+            time_t pieceEnd = end < dayUntil ? end : dayUntil;
+            int64_t seconds = static_cast<int64_t>(pieceEnd - start);
+
+            Day& day = days[dayKey];
+            accumulate(day.categories[categoryName], seconds);
+            if (process != StringPool::Empty) {
+                accumulate(day.processes[processName], seconds);
+            }
+            start = pieceEnd;
+        }
+        dirty = true;
+    }
+
+    bool isDirty() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dirty;
+    }
+
+    // Rewrites the side file through a temporary file so readers never see a
+    // half-written one
+    bool save() {
+        std::string text = "Day,Kind,Name,Seconds,Segments,LongestSeconds\n";
+        std::string target;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!dirty || path.empty()) return true;
+            for (const auto& day : days) {
+                appendRows(text, day.first, "Category", day.second.categories);
+                appendRows(text, day.first, "Process", day.second.processes);
+            }
+            target = path;
+            dirty = false;
+        }
+
+        std::string temp = target + ".tmp";
+        HANDLE file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        bool ok = file != INVALID_HANDLE_VALUE;
+        if (ok) {
+            DWORD written = 0;
+            ok = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, NULL) &&
+                 written == text.size();
+            CloseHandle(file);
+        }
+        if (!ok || !MoveFileExA(temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileA(temp.c_str());
+            std::lock_guard<std::mutex> lock(mutex);
+            dirty = true;
+            return false;
+        }
+        return true;
+    }
+
+    // Totals over the days [firstDay, lastDay], by name, largest first
+    std::vector<std::pair<std::string, Totals>> totals(Kind kind, int32_t firstDay, int32_t lastDay) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<uint32_t, Totals> combined;
+        for (auto it = days.lower_bound(firstDay); it != days.end() && it->first <= lastDay; ++it) {
+            const auto& source = (kind == Kind::Category) ? it->second.categories : it->second.processes;
+            for (const auto& entry : source) {
+                merge(combined[entry.first], entry.second);
+            }
+        }
+
+        std::vector<std::pair<std::string, Totals>> result;
+        result.reserve(combined.size());
+        for (const auto& entry : combined) {
+            result.emplace_back(names[entry.first], entry.second);
+        }
+        std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+            return a.second.seconds > b.second.seconds;
+        });
+        return result;
+    }
+
+    Totals total(Kind kind, const std::string& name, int32_t day) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto dayIt = days.find(day);
+        auto nameIt = nameIds.find(name);
+        if (dayIt == days.end() || nameIt == nameIds.end()) return Totals();
+        const auto& source = (kind == Kind::Category) ? dayIt->second.categories : dayIt->second.processes;
+        auto it = source.find(nameIt->second);
+        return it != source.end() ? it->second : Totals();
+    }
+};
+
+// Feeds every logged segment into the day totals and saves them at most
+// every SaveMs, and when the pipeline stops
+class AggregatesSink : public ISegmentSink {
+private:
+    static constexpr DWORD SaveMs = 5 * 60 * 1000;
+
+    const StringPool* strings;
+    ActivityAggregates aggregates;
+    ULONGLONG savedAt;
+
+public:
+    // The pool must outlive the sink
+    AggregatesSink(const std::string& totalsPath, const StringPool& pool) : strings(&pool), savedAt(GetTickCount64()) {
+        aggregates.load(totalsPath);
+    }
+
+    const char* name() const override { return "Totals"; }
+    bool wantsWindow() const override { return false; }
+
+    void consume(LogRecord&& record) override {
+        aggregates.add(std::chrono::system_clock::to_time_t(record.start),
+                       std::chrono::system_clock::to_time_t(record.end),
+                       record.process, record.category, *strings);
+    }
+
+    DWORD service(bool) override {
+        if (!aggregates.isDirty()) return INFINITE;
+        ULONGLONG age = GetTickCount64() - savedAt;
+        if (age < SaveMs) return static_cast<DWORD>(SaveMs - age);
+        aggregates.save();
+        savedAt = GetTickCount64();
+        return INFINITE;
+    }
+
+    void close() override {
+        aggregates.save();
+    }
+
+    // Safe to query from any thread
+    const ActivityAggregates& getAggregates() const { return aggregates; }
+};
@@ -6,6 +6,7 @@
 #include <shellapi.h>
 #include <commctrl.h>
 #include <commdlg.h>
+#include <wtsapi32.h>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -15,52 +16,250 @@
 #include <mutex>
 #include <map>
 #include <memory>
-#include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <functional>
+#include <cwchar>
+#include <cwctype>
+#include <string_view>
+#include "AllocationCounter.h"
+#include "ActivityAggregates.h"
+#include "ColdStorage.h"
+#include "ForegroundCapture.h"
+#include "HostLink.h"
+#include "LogQuery.h"
+#include "LogReport.h"
+#include "LogViewer.h"
+#include "LoggerStats.h"
+#include "LogWriter.h"
+#include "SamplingScheduler.h"
+#include "SegmentClassifier.h"
+#include "SegmentCoalescer.h"
+#include "SegmentJournal.h"
+#include "SegmentSink.h"
+#include "SessionHost.h"
+#include "StringPool.h"
+#include "Timestamp.h"
+#include "UploadSink.h"
+#include "Utf8.h"
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "psapi.lib")
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(lib, "comdlg32.lib")
+#pragma comment(lib, "wtsapi32.lib")
+
+#define IDLE_TIMER_ID 1
+
+// Posted to the hidden window: the log path is known; create the tray icon
+#define WM_LOGGER_STARTUP (WM_APP + 1)
+#define WM_LOGGER_TRAY (WM_APP + 2)
+
+// Segments kept in memory while the log path is still being resolved
+#define MAX_EARLY_RECORDS 4096
+
+// In event mode the idle timer doubles as the journal heartbeat, so a crash
+// loses at most this much of the open segment
+#define JOURNAL_HEARTBEAT_MS 60000
+
+// How often the TraceLogging build emits the counters
+#define STATS_TRACE_INTERVAL_MS 60000
 
 class ActivityLogger {
 private:
     std::string logPath;
-    bool running;
+    Settings settings;
+    std::atomic<bool> running;
     std::thread loggerThread;
-    std::mutex dataMutex;
+    HANDLE pollWakeEvent;
+    SamplingScheduler scheduler;
+    
+    // Interned process names, details and categories; declared before the
+    // sinks, which resolve IDs until the pipeline is stopped
+    StringPool strings;
+    
+    // capture -> classify -> sinks. The pipeline owns the sinks; each runs
+    // on its own thread behind its own queue, so none can stall sampling.
+    ForegroundCapture capture;
+    SegmentClassifier classifier;
+    SegmentCoalescer coalescer;
+    SegmentPipeline pipeline;
+    LogWriter* logFile;
+    AggregatesSink* totals;
+    UploadSink* uploader;       // only when [Upload] Url is set
+    HostForwardSink* forwarder; // agent mode's only sink (see SessionHost.h)
     
     // Window tracking
-    std::string prevWindow;
-    std::string prevProcess;
-    std::string prevDetails;
-    std::string prevCategory;
-    std::chrono::system_clock::time_point startTime;
+    TitleBuffer prevWindow;
+    uint32_t prevProcess;
+    uint32_t prevDetails;
+    uint32_t prevCategory;
+    Timestamp startTime;
     std::chrono::system_clock::time_point appStartTime;
     
     // Idle detection
     bool wasIdle;
-    std::chrono::system_clock::time_point idleStart;
+    Timestamp idleStart;
+    
+    // Lock, disconnect and suspend pause sampling entirely. Set on the
+    // message-loop thread; in polling mode the poller applies the change.
+    enum PauseReason : unsigned { PausedLocked = 1, PausedDisconnected = 2, PausedSuspended = 4 };
+    std::atomic<unsigned> pauseReasons;
+    std::atomic<std::chrono::steady_clock::rep> pausedSince;
+    std::atomic<bool> sleptWhilePaused;
+    
+    // Foreground tracking: WinEvent hooks on the message-loop thread, with the
+    // polling thread as a fallback when the hooks cannot be installed
+    enum class TrackingMode { Events, Polling };
+    TrackingMode trackingMode;
+    HWINEVENTHOOK foregroundHook;
+    HWINEVENTHOOK nameChangeHook;
+    DWORD nameChangeProcessId;
+    static ActivityLogger* hookOwner;
+    
+    // Only touched by the thread that is currently sampling
+    ForegroundSnapshot snapshot;
+    SegmentJournal journal;
+    uint64_t steadyStateAllocations;
+    SamplerStats samplerStats;
+    ULONGLONG statsTracedAt;
+    
+    // Interned IDs of fixed labels
+    uint32_t inactiveId;
+    uint32_t meetingsId;
     
     // Tray icon
     NOTIFYICONDATA nid;
     HWND hwnd;
     HMENU hMenu;
+    bool trayAdded;
+    ULONGLONG tooltipUpdatedAt;
     
     // Viewer window
+    std::unique_ptr<LogViewer> viewer;
     HWND viewerHwnd;
     bool viewerOpen;
+    
+    // Index over the active CSV log, kept so each "today" request from the
+    // tray reads only the rows appended since the last one
+    std::unique_ptr<LogQuery> recentQuery;
+    
+    // Deferred startup. Sampling begins at once; finding the log folder
+    // (OneDrive may still be mounting at sign-in) happens on startupThread,
+    // and until the sinks exist finished segments wait in earlyRecords.
+    bool agentMode;
+    std::thread startupThread;
+    std::atomic<bool> pathResolved;
+    std::string resolvedPath;
+    std::atomic<bool> startupDone;
+    std::vector<LogRecord> earlyRecords;
+    uint64_t earlyDropped;
 
 public:
-    ActivityLogger() : running(false), wasIdle(false), viewerOpen(false), viewerHwnd(nullptr) {
+    // The log normally goes where getLogPath finds; the replay benchmark
+    // points it at its own folder. An agent keeps its settings and rules
+    // there too but hands every segment to the session host.
+    explicit ActivityLogger(const std::string& logPathOverride = std::string(), bool agent = false)
+                     : running(false), pollWakeEvent(nullptr), classifier(strings), logFile(nullptr), totals(nullptr), uploader(nullptr), forwarder(nullptr),
+                       prevProcess(StringPool::Empty), prevDetails(StringPool::Empty),
+                       prevCategory(StringPool::Empty), wasIdle(false), pauseReasons(0), pausedSince(0), sleptWhilePaused(false), trackingMode(TrackingMode::Polling),
+                       foregroundHook(nullptr), nameChangeHook(nullptr), nameChangeProcessId(0),
+                       steadyStateAllocations(0), statsTracedAt(0),
+                       hwnd(nullptr), hMenu(nullptr), trayAdded(false), tooltipUpdatedAt(0), viewerHwnd(nullptr), viewerOpen(false),
+                       agentMode(agent), pathResolved(false), startupDone(false), earlyDropped(0) {
         appStartTime = std::chrono::system_clock::now();
-        logPath = getLogPath();
+        scheduler.configure(settings.sampling);
+        coalescer.configure(settings.segments);
+        pollWakeEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+        inactiveId = strings.intern(L"Inactive");
+        meetingsId = strings.intern(L"Meetings");
+        if (!logPathOverride.empty()) {
+            logPath = logPathOverride;
+            finishStartup();
+        }
+    }
+
+    // Everything that needs the log folder: settings, rules, sinks and the
+    // journal. On the thread that is currently sampling, or with sampling
+    // stopped.
+    void finishStartup() {
+        settings = Settings::load(getLogFolder() + "ActivityLogger.ini");
+        scheduler.configure(settings.sampling);
+        coalescer.configure(settings.segments);
+        if (settings.browserSites) {
+            capture.enableBrowserSites();
+        }
+        classifier.start(getCategoryRulesPath());
+        if (agentMode) {
+            forwarder = pipeline.add(std::make_unique<HostForwardSink>(strings));
+        } else {
+            logFile = pipeline.add(std::make_unique<LogWriter>(logPath, settings, strings));
+            totals = pipeline.add(std::make_unique<AggregatesSink>(segmentLogBase(logPath) + "_Totals.csv", strings));
+            if (!settings.upload.url.empty()) {
+                auto upload = std::make_unique<UploadSink>(settings.upload, segmentLogBase(logPath) + "_Spool\\", strings);
+                if (upload->isUsable()) {
+                    uploader = pipeline.add(std::move(upload));
+                } else {
+                    OutputDebugStringA("ActivityLogger: upload disabled; check [Upload] Url\n");
+                }
+            }
+        }
+        pipeline.start();
+        openJournal();
+        
+        // What was logged before the rules were known, then the open segment.
+        // A held segment is let go first so it is recategorized with the rest.
+        logSegment(coalescer.flush());
+        for (LogRecord& record : earlyRecords) {
+            if (record.process != StringPool::Empty) {
+                record.category = classifier.recategorize(record.process, record.window, record.details);
+            }
+            pipeline.submit(std::move(record));
+        }
+        earlyRecords.clear();
+        earlyRecords.shrink_to_fit();
+        if (!prevWindow.empty() && !wasIdle) {
+            prevCategory = classifier.recategorize(prevProcess, prevWindow.view(), prevDetails);
+            journalSegment();
+        }
+        startupDone = true;
+    }
+
+    // Probes for the log folder off the sampling and message threads. The
+    // result is picked up by whichever thread samples next.
+    void resolveLogPath() {
+        if (startupDone || startupThread.joinable()) return;
+        startupThread = std::thread([this] {
+            resolvedPath = getLogPath();
+            pathResolved = true;
+            SetEvent(pollWakeEvent);
+            if (hwnd) PostMessage(hwnd, WM_LOGGER_STARTUP, 0, 0);
+        });
+    }
+
+    // Blocks only if the probe is still running (a very early stop)
+    void completeStartup() {
+        if (startupDone) return;
+        if (startupThread.joinable()) startupThread.join();
+        if (!pathResolved) return;
+        logPath = resolvedPath;
+        finishStartup();
+    }
+
+    // WM_LOGGER_STARTUP. The poller finishes startup itself.
+    void handleStartupReady() {
+        if (!running || trackingMode == TrackingMode::Events) {
+            completeStartup();
+        }
     }
 
     ~ActivityLogger() {
         stop();
+        if (startupThread.joinable()) startupThread.join();
+        pipeline.stop();
+        classifier.stop();
+        CloseHandle(pollWakeEvent);
         if (viewerOpen && viewerHwnd) {
             DestroyWindow(viewerHwnd);
         }
@@ -99,253 +298,511 @@ public:
         return "ActivityLog.csv";
     }
 
-    std::string getActiveWindowTitle() {
-        HWND hwnd = GetForegroundWindow();
-        if (!hwnd) return "";
-        
-        char title[256];
-        GetWindowTextA(hwnd, title, sizeof(title));
-        return std::string(title);
-    }
-
-    std::string getActiveProcessName() {
-        HWND hwnd = GetForegroundWindow();
-        if (!hwnd) return "";
-        
-        DWORD processId;
-        GetWindowThreadProcessId(hwnd, &processId);
-        
-        HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, processId);
-        if (!hProcess) return "";
-        
-        char processName[MAX_PATH];
-        DWORD size = MAX_PATH;
-        if (QueryFullProcessImageNameA(hProcess, 0, processName, &size)) {
-            CloseHandle(hProcess);
-            std::string fullPath(processName);
-            size_t pos = fullPath.find_last_of("\\/");
-            return (pos != std::string::npos) ? fullPath.substr(pos + 1) : fullPath;
-        }
-        
-        CloseHandle(hProcess);
-        return "";
-    }
-
-    std::string getWindowDetails(const std::string& windowTitle, const std::string& processName) {
-        std::string title = windowTitle;
-        std::string proc = processName;
-        std::transform(proc.begin(), proc.end(), proc.begin(), ::tolower);
-        
-        // Remove common application suffixes
-        if (proc == "excel.exe" && title.find(" - Excel") != std::string::npos) {
-            size_t pos = title.find(" - Excel");
-            return title.substr(0, pos);
-        } else if (proc == "winword.exe" && title.find(" - Word") != std::string::npos) {
-            size_t pos = title.find(" - Word");
-            return title.substr(0, pos);
-        } else if (proc == "chrome.exe" && title.find(" - Google Chrome") != std::string::npos) {
-            size_t pos = title.find(" - Google Chrome");
-            return title.substr(0, pos);
-        } else if (title.find(" - ") != std::string::npos) {
-            size_t pos = title.rfind(" - ");
-            return title.substr(0, pos);
-        }
-        
-        return title;
-    }
-
-    std::string getCategory(const std::string& windowTitle, const std::string& processName, const std::string& windowDetails) {
-        std::string proc = processName;
-        std::string title = windowTitle;
-        std::string details = windowDetails;
-        
-        std::transform(proc.begin(), proc.end(), proc.begin(), ::tolower);
-        std::transform(title.begin(), title.end(), title.begin(), ::tolower);
-        std::transform(details.begin(), details.end(), details.begin(), ::tolower);
-        
-        std::map<std::string, std::string> categories = {
-            {"excel", "Work - Office"},
-            {"winword", "Work - Office"},
-            {"powerpnt", "Work - Office"},
-            {"outlook", "Email"},
-            {"chrome", "Web Browsing"},
-            {"firefox", "Web Browsing"},
-            {"msedge", "Web Browsing"},
-            {"teams", "Meetings"},
-            {"slack", "Communication"},
-            {"zoom", "Meetings"},
-            {"notepad", "Notes"},
-            {"code", "Development"},
-            {"cmd", "Terminal"},
-            {"powershell", "Terminal"}
-        };
-        
-        for (const auto& pair : categories) {
-            if (proc.find(pair.first) != std::string::npos ||
-                title.find(pair.first) != std::string::npos ||
-                details.find(pair.first) != std::string::npos) {
-                return pair.second;
-            }
-        }
-        
-        return "Uncategorized";
+    // Category rules live next to the log, in the file the Python tools keep
+    std::string getCategoryRulesPath() const {
+        return getLogFolder() + "ActivitySummary.csv";
+    }
+
+    // Folder of the log file, with a trailing separator
+    std::string getLogFolder() const {
+        size_t pos = logPath.find_last_of("\\/");
+        return (pos != std::string::npos) ? logPath.substr(0, pos + 1) : "";
     }
 
     int getIdleSeconds() {
         LASTINPUTINFO lii;
         lii.cbSize = sizeof(LASTINPUTINFO);
-        if (GetLastInputInfo(&lii)) {
-            DWORD tickCount = GetTickCount();
+        if (desktop::lastInputInfo(&lii)) {
+            DWORD tickCount = desktop::tickCount();
             return (tickCount - lii.dwTime) / 1000;
         }
         return 0;
     }
 
-    void logActivity(const std::chrono::system_clock::time_point& start,
-                    const std::chrono::system_clock::time_point& end,
-                    const std::string& window,
-                    const std::string& process,
-                    const std::string& details,
-                    const std::string& category) {
-        
-        std::lock_guard<std::mutex> lock(dataMutex);
+    // The segment is measured on the monotonic clock; its wall-clock end is
+    // derived from the start's anchor so the two always agree
+    void logActivity(const Timestamp& start,
+                    const std::chrono::steady_clock::time_point& end,
+                    std::wstring_view window,
+                    uint32_t process,
+                    uint32_t details,
+                    uint32_t category) {
         
-        auto duration = std::chrono::duration_cast<std::chrono::seconds>(end - start).count();
+        auto duration = std::chrono::duration_cast<std::chrono::seconds>(end - start.steady).count();
         if (duration <= 0) return;
         
-        bool fileExists = (GetFileAttributesA(logPath.c_str()) != INVALID_FILE_ATTRIBUTES);
-        std::ofstream file(logPath, std::ios::app);
-        
-        if (!file.is_open()) return;
+        // Only the thread that is currently sampling gets here, so the
+        // pipeline's queues keep their single producer
+        samplerStats.segments.add();
+        if (!startupDone) {
+            if (earlyRecords.size() < MAX_EARLY_RECORDS) {
+                earlyRecords.push_back(LogRecord{ start.wall, start.wallAt(end), std::wstring(window), process, details, category });
+            } else {
+                earlyDropped++;
+            }
+            return;
+        }
+        pipeline.submit(LogRecord{ start.wall, start.wallAt(end), std::wstring(window), process, details, category });
+    }
+
+    void logSegment(const SegmentCoalescer::Segment* segment) {
+        if (segment) {
+            logActivity(segment->start, segment->end, segment->window, segment->process, segment->details,
+                        segment->category);
+        }
+    }
+
+    // Ends the open segment at end; the coalescer decides when it is logged
+    void closeSegment(const std::chrono::steady_clock::time_point& end) {
+        logSegment(coalescer.close(startTime, end, prevWindow.view(), prevProcess, prevDetails, prevCategory));
+    }
+
+    // The log file's, or in agent mode what reached the host
+    const WriterStats& writerStats() const {
+        static const WriterStats starting;
+        if (!startupDone) return starting;
+        return logFile ? logFile->getStats() : forwarder->getStats();
+    }
+
+    static int64_t wallMs(const std::chrono::system_clock::time_point& time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+
+    // Logs the segment a crashed run left open, then starts journaling ours
+    void openJournal() {
+        SegmentJournal::Recovered recovered;
+        bool hasRecovered = false;
+        if (!journal.open(segmentLogBase(logPath) + ".journal", recovered, hasRecovered) || !hasRecovered) return;
         
-        if (!fileExists) {
-            file << "StartTime,EndTime,DurationSeconds,WindowTitle,WindowDetails,ProcessName,Category\n";
+        std::chrono::system_clock::time_point start(std::chrono::milliseconds(recovered.startMs));
+        std::chrono::system_clock::time_point end(std::chrono::milliseconds(recovered.endMs));
+        pipeline.submit(LogRecord{ start, end, std::move(recovered.window), strings.intern(recovered.process),
+                                    strings.intern(recovered.details), strings.intern(recovered.category) });
+    }
+
+    // Mirrors the open segment into the journal
+    void journalSegment() {
+        if (prevWindow.empty()) {
+            journal.clear();
+            return;
+        }
+        journal.begin(wallMs(startTime.wall), prevWindow.view(), strings.get(prevProcess),
+                      strings.get(prevDetails), strings.get(prevCategory));
+    }
+
+    void journalHeartbeat(const std::chrono::steady_clock::time_point& now) {
+        if (!wasIdle) {
+            journal.touch(wallMs(startTime.wallAt(now)));
         }
+    }
+
+    // Closes the current segment if the foreground window changed. Called per
+    // tick by the poller and per WinEvent in event mode, with the time at which
+    // the change actually happened.
+    void onActivitySample(const std::chrono::steady_clock::time_point& now) {
+        classifier.adoptRules();
+        uint64_t allocationsBefore = threadAllocationCount();
         
-        auto startTime_t = std::chrono::system_clock::to_time_t(start);
-        auto endTime_t = std::chrono::system_clock::to_time_t(end);
+        // Get current window info
+        samplerStats.samples.add();
+        int64_t captureStart = qpcNow();
+        capture.capture(snapshot, strings);
+        samplerStats.capture.record(captureStart);
+        int64_t classifyStart = qpcNow();
+        const Classification& current = classifier.classify(snapshot.process, snapshot.title.view(), snapshot.site.view());
+        samplerStats.classify.record(classifyStart);
         
-        struct tm startTm, endTm;
-        localtime_s(&startTm, &startTime_t);
-        localtime_s(&endTm, &endTime_t);
+        // Check if window changed. On a known browser site the title alone
+        // (page loads, notification counts) does not start a segment.
+        if (current.details != prevDetails || 
+            current.category != prevCategory ||
+            (snapshot.site.empty() && snapshot.title.view() != prevWindow.view())) {
+            
+            // Log previous activity
+            if (!prevWindow.empty() && !wasIdle) {
+                closeSegment(now);
+            }
+            
+            // Update to new window, or back to one left only briefly
+            prevWindow.assign(snapshot.title);
+            prevProcess = snapshot.process;
+            prevDetails = current.details;
+            prevCategory = current.category;
+            startTime = Timestamp::at(now);
+            coalescer.resume(prevProcess, prevDetails, prevCategory, startTime);
+            journalSegment();
+            scheduler.onActivity();
+        } else {
+            journalHeartbeat(now);
+            
+            // An unchanged sample must not allocate (see AllocationCounter.h)
+            steadyStateAllocations += threadAllocationCount() - allocationsBefore;
+            logSegment(coalescer.settle(now, startTime.steady));
+        }
+    }
+
+    // Release builds have no console; errors are counted for Diagnostics and
+    // go to the debugger output
+    void reportError(const char* context, const std::exception& e) {
+        samplerStats.errors.add();
+        OutputDebugStringA((std::string("ActivityLogger: ") + context + ": " + e.what() + "\n").c_str());
+    }
+
+    void traceStatsIfDue() {
+        ULONGLONG now = GetTickCount64();
+        if (now - statsTracedAt < STATS_TRACE_INTERVAL_MS) return;
+        statsTracedAt = now;
+        traceStats(samplerStats, writerStats(), classifier.getCache().getHits(),
+                   classifier.getCache().getMisses(), getDroppedRecords());
+    }
+
+    // Returns the idle threshold for the current segment in seconds
+    int getIdleThreshold() const {
+        return (prevCategory == meetingsId) ? 3600 : 300; // 1 hour for meetings, 5 min for others
+    }
+
+    void checkIdle(const std::chrono::steady_clock::time_point& now) {
+        int idleSeconds = getIdleSeconds();
+        bool isIdle = idleSeconds >= getIdleThreshold();
         
-        file << std::put_time(&startTm, "%Y-%m-%d %H:%M:%S") << ","
-             << std::put_time(&endTm, "%Y-%m-%d %H:%M:%S") << ","
-             << duration << ","
-             << "\"" << window << "\","
-             << "\"" << details << "\","
-             << "\"" << process << "\","
-             << "\"" << category << "\"\n";
+        if (isIdle && !wasIdle) {
+            goIdle(now);
+        } else if (!isIdle && wasIdle) {
+            becomeActive(Timestamp::at(now));
+        }
+    }
+
+    // Closes the open segment at the moment the user left
+    void goIdle(const std::chrono::steady_clock::time_point& when) {
+        idleStart = Timestamp::at(when);
         
-        file.close();
+        // Log current activity before going idle
+        if (!prevWindow.empty()) {
+            closeSegment(when);
+        }
+        logSegment(coalescer.flush());
+        journal.clear();
+        wasIdle = true;
     }
 
-    void pollingLoop() {
-        std::cout << "Starting polling method\n";
+    void becomeActive(const Timestamp& now) {
+        auto idleDuration = std::chrono::duration_cast<std::chrono::seconds>(now.steady - idleStart.steady).count();
+        
+        if (idleDuration >= 300) { // Log idle periods longer than 5 minutes
+            logActivity(idleStart, now.steady, L"Inactive", StringPool::Empty, StringPool::Empty, inactiveId);
+        }
         
-        startTime = std::chrono::system_clock::now();
-        prevWindow = getActiveWindowTitle();
-        prevProcess = getActiveProcessName();
-        prevDetails = getWindowDetails(prevWindow, prevProcess);
-        prevCategory = getCategory(prevWindow, prevProcess, prevDetails);
+        // Reset for new activity
+        startTime = now;
         wasIdle = false;
+        resetToForeground();
+    }
+
+    bool isPaused() const { return pauseReasons.load() != 0; }
+
+    // A pause counts as idle from the moment it began, whatever the idle
+    // threshold, so the locked or suspended time is never billed to a window
+    void enterPause(const std::chrono::steady_clock::time_point& when) {
+        if (!wasIdle) {
+            goIdle(when);
+        }
+    }
+
+    void leavePause() {
+        Timestamp now = Timestamp::now();
         
-        int idleCheckCounter = 0;
-        const int idleCheckFrequency = 10; // Check idle every 5 seconds (10 * 0.5s)
+        // The monotonic clock need not advance while the machine sleeps; a
+        // pause that spanned a suspend is measured on the wall clock instead
+        if (sleptWhilePaused.exchange(false)) {
+            auto asleep = now.wall - idleStart.wallAt(now.steady);
+            if (asleep.count() > 0) {
+                idleStart.steady -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(asleep);
+            }
+        }
+        becomeActive(now);
+    }
+
+    // Message-loop thread
+    void setPauseReason(unsigned reason, bool active) {
+        unsigned before = pauseReasons.load();
+        unsigned after = active ? (before | reason) : (before & ~reason);
+        if (after && !before) {
+            pausedSince = std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+        if (reason == PausedSuspended && active) {
+            sleptWhilePaused = true;
+        }
+        pauseReasons = after;
+        if (!running || (before != 0) == (after != 0)) return;
+        
+        if (trackingMode == TrackingMode::Events) {
+            try {
+                if (after) {
+                    KillTimer(hwnd, IDLE_TIMER_ID);
+                    enterPause(pausedAt());
+                } else {
+                    leavePause();
+                    watchForegroundTitle(GetForegroundWindow());
+                    scheduleIdleCheck();
+                }
+            } catch (const std::exception& e) {
+                reportError("Error pausing", e);
+            }
+        } else {
+            SetEvent(pollWakeEvent);
+        }
+    }
+
+    std::chrono::steady_clock::time_point pausedAt() const {
+        return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(pausedSince.load()));
+    }
+
+    // Makes the current foreground window the open segment
+    void resetToForeground() {
+        capture.capture(snapshot, strings);
+        const Classification& current = classifier.classify(snapshot.process, snapshot.title.view(), snapshot.site.view());
+        prevDetails = current.details;
+        prevCategory = current.category;
+        prevWindow.assign(snapshot.title);
+        prevProcess = snapshot.process;
+        journalSegment();
+    }
+
+    void beginTracking() {
+        startTime = Timestamp::now();
+        resetToForeground();
+        wasIdle = false;
+    }
+
+    // The interval adapts to input and power state (see SamplingScheduler);
+    // stop() wakes the wait so a long back-off never delays shutdown
+    void pollingLoop() {
+        OutputDebugStringA("ActivityLogger: polling for foreground changes\n");
         
+        bool paused = false;
         while (running) {
             try {
-                // Get current window info
-                std::string currentWindow = getActiveWindowTitle();
-                std::string currentProcess = getActiveProcessName();
-                std::string currentDetails = getWindowDetails(currentWindow, currentProcess);
-                std::string currentCategory = getCategory(currentWindow, currentProcess, currentDetails);
-                
-                // Check if window changed
-                if (currentWindow != prevWindow || 
-                    currentDetails != prevDetails || 
-                    currentCategory != prevCategory) {
-                    
-                    // Log previous activity
-                    if (!prevWindow.empty() && !wasIdle) {
-                        auto endTime = std::chrono::system_clock::now();
-                        auto duration = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
-                        if (duration >= 1) {
-                            logActivity(startTime, endTime, prevWindow, prevProcess, prevDetails, prevCategory);
-                        }
-                    }
-                    
-                    // Update to new window
-                    prevWindow = currentWindow;
-                    prevProcess = currentProcess;
-                    prevDetails = currentDetails;
-                    prevCategory = currentCategory;
-                    startTime = std::chrono::system_clock::now();
+                if (pathResolved && !startupDone) {
+                    completeStartup();
                 }
-                
-                // Check idle status periodically
-                idleCheckCounter++;
-                if (idleCheckCounter >= idleCheckFrequency) {
-                    idleCheckCounter = 0;
-                    
-                    int idleSeconds = getIdleSeconds();
-                    int idleThreshold = (prevCategory == "Meetings") ? 3600 : 300; // 1 hour for meetings, 5 min for others
-                    bool isIdle = idleSeconds >= idleThreshold;
-                    
-                    if (isIdle && !wasIdle) {
-                        // Just went idle
-                        idleStart = std::chrono::system_clock::now();
-                        
-                        // Log current activity before going idle
-                        if (!prevWindow.empty()) {
-                            auto duration = std::chrono::duration_cast<std::chrono::seconds>(idleStart - startTime).count();
-                            if (duration >= 1) {
-                                logActivity(startTime, idleStart, prevWindow, prevProcess, prevDetails, prevCategory);
-                            }
-                        }
-                        wasIdle = true;
-                        
-                    } else if (!isIdle && wasIdle) {
-                        // Just became active
-                        auto now = std::chrono::system_clock::now();
-                        auto idleDuration = std::chrono::duration_cast<std::chrono::seconds>(now - idleStart).count();
-                        
-                        if (idleDuration >= 300) { // Log idle periods longer than 5 minutes
-                            logActivity(idleStart, now, "Inactive", "", "", "Inactive");
-                        }
-                        
-                        // Reset for new activity
-                        startTime = now;
-                        wasIdle = false;
-                        prevWindow = currentWindow;
-                        prevProcess = currentProcess;
-                        prevDetails = currentDetails;
-                        prevCategory = currentCategory;
+                if (isPaused() != paused) {
+                    paused = !paused;
+                    if (paused) {
+                        enterPause(pausedAt());
+                    } else {
+                        leavePause();
                     }
                 }
-                
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                
+                if (!paused) {
+                    auto now = std::chrono::steady_clock::now();
+                    onActivitySample(now);
+                    checkIdle(now);
+                    traceStatsIfDue();
+                }
             } catch (const std::exception& e) {
-                std::cerr << "Error in polling loop: " << e.what() << std::endl;
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                reportError("Error in polling loop", e);
+            }
+            WaitForSingleObject(pollWakeEvent, paused ? INFINITE : scheduler.nextDelay());
+        }
+    }
+
+    // Event-driven tracking. The hooks are out-of-context, so callbacks arrive
+    // on the thread that installed them (the WinMain message loop) and nothing
+    // runs between focus or title changes except the idle timer.
+    static void CALLBACK winEventProc(HWINEVENTHOOK hook, DWORD event, HWND eventHwnd,
+                                      LONG idObject, LONG idChild,
+                                      DWORD eventThread, DWORD eventTime) {
+        if (hookOwner) {
+            hookOwner->onWinEvent(event, eventHwnd, idObject, idChild, eventTime);
+        }
+    }
+
+    void onWinEvent(DWORD event, HWND eventHwnd, LONG idObject, LONG idChild, DWORD eventTime) {
+        if (!running || trackingMode != TrackingMode::Events || isPaused()) return;
+        
+        // Only title changes of the foreground top-level window matter
+        if (event == EVENT_OBJECT_NAMECHANGE &&
+            (idObject != OBJID_WINDOW || idChild != CHILDID_SELF || eventHwnd != GetForegroundWindow())) {
+            return;
+        }
+        
+        try {
+            // dwmsEventTime is on the GetTickCount clock; back-date the switch to it
+            DWORD ageMs = GetTickCount() - eventTime;
+            if (ageMs > 60000) ageMs = 0;
+            auto when = std::chrono::steady_clock::now() - std::chrono::milliseconds(ageMs);
+            if (when < startTime.steady) when = startTime.steady;
+            
+            onActivitySample(when);
+            if (coalescer.holding()) {
+                scheduleIdleCheck();
+            }
+            
+            if (event == EVENT_SYSTEM_FOREGROUND) {
+                watchForegroundTitle(eventHwnd);
+            }
+        } catch (const std::exception& e) {
+            reportError("Error in foreground event", e);
+        }
+    }
+
+    // Name changes are scoped to the foreground process so title churn in
+    // background applications never reaches us
+    void watchForegroundTitle(HWND foreground) {
+        DWORD processId = 0;
+        if (foreground) {
+            GetWindowThreadProcessId(foreground, &processId);
+        }
+        if (processId == nameChangeProcessId && nameChangeHook) return;
+        
+        if (nameChangeHook) {
+            UnhookWinEvent(nameChangeHook);
+            nameChangeHook = nullptr;
+        }
+        nameChangeProcessId = processId;
+        if (processId) {
+            nameChangeHook = SetWinEventHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, NULL,
+                                             winEventProc, processId, 0,
+                                             WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+        }
+    }
+
+    bool installEventHooks() {
+        if (!hwnd) return false;
+        
+        hookOwner = this;
+        foregroundHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+                                         winEventProc, 0, 0,
+                                         WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+        if (!foregroundHook) {
+            hookOwner = nullptr;
+            return false;
+        }
+        
+        watchForegroundTitle(GetForegroundWindow());
+        scheduleIdleCheck();
+        return true;
+    }
+
+    void removeEventHooks() {
+        KillTimer(hwnd, IDLE_TIMER_ID);
+        if (nameChangeHook) {
+            UnhookWinEvent(nameChangeHook);
+            nameChangeHook = nullptr;
+        }
+        nameChangeProcessId = 0;
+        if (foregroundHook) {
+            UnhookWinEvent(foregroundHook);
+            foregroundHook = nullptr;
+        }
+        hookOwner = nullptr;
+    }
+
+    // While active, the next idle check is due no earlier than the moment the
+    // threshold could be crossed; while idle, poll for the user returning at
+    // the scheduler's backed-off rate.
+    void scheduleIdleCheck() {
+        UINT delayMs = scheduler.nextDelay();
+        if (!wasIdle) {
+            int remaining = getIdleThreshold() - getIdleSeconds();
+            delayMs = remaining > 5 ? remaining * 1000 : 5000;
+            if (delayMs > JOURNAL_HEARTBEAT_MS) delayMs = JOURNAL_HEARTBEAT_MS;
+            
+            // Let a held segment go soon after it can no longer merge
+            if (coalescer.holding() && delayMs > coalescer.holdMs() + 1000) delayMs = coalescer.holdMs() + 1000;
+        }
+        SetTimer(hwnd, IDLE_TIMER_ID, delayMs, NULL);
+    }
+
+    void handleTimer(WPARAM timerId) {
+        if (timerId != IDLE_TIMER_ID || !running || trackingMode != TrackingMode::Events || isPaused()) return;
+        
+        try {
+            auto now = std::chrono::steady_clock::now();
+            checkIdle(now);
+            journalHeartbeat(now);
+            if (!wasIdle) {
+                logSegment(coalescer.settle(now, startTime.steady));
             }
+            traceStatsIfDue();
+        } catch (const std::exception& e) {
+            reportError("Error in idle check", e);
         }
+        scheduleIdleCheck();
     }
 
+    // WM_WTSSESSION_CHANGE, for this session only
+    void handleSessionChange(WPARAM change) {
+        switch (change) {
+            case WTS_SESSION_LOCK:
+                setPauseReason(PausedLocked, true);
+                break;
+            case WTS_SESSION_UNLOCK:
+                setPauseReason(PausedLocked, false);
+                break;
+            case WTS_CONSOLE_DISCONNECT:
+            case WTS_REMOTE_DISCONNECT:
+                setPauseReason(PausedDisconnected, true);
+                break;
+            case WTS_CONSOLE_CONNECT:
+            case WTS_REMOTE_CONNECT:
+                setPauseReason(PausedDisconnected, false);
+                break;
+        }
+    }
+
+    // WM_POWERBROADCAST. The suspend notice arrives while the clock is still
+    // running, so the open segment ends at the real time of sleep.
+    void handlePowerBroadcast(WPARAM event) {
+        switch (event) {
+            case PBT_APMSUSPEND:
+                setPauseReason(PausedSuspended, true);
+                break;
+            case PBT_APMRESUMEAUTOMATIC:
+            case PBT_APMRESUMESUSPEND:
+                setPauseReason(PausedSuspended, false);
+                break;
+        }
+    }
+
+    // Must be called on the message-loop thread so the WinEvent hooks and
+    // the idle timer are delivered through it
     void start() {
         if (!running) {
             running = true;
-            loggerThread = std::thread(&ActivityLogger::pollingLoop, this);
+            resolveLogPath();
+            beginTracking();
+            if (installEventHooks()) {
+                trackingMode = TrackingMode::Events;
+                OutputDebugStringA("ActivityLogger: tracking foreground changes through event hooks\n");
+                if (isPaused()) {
+                    enterPause(pausedAt());
+                }
+            } else {
+                trackingMode = TrackingMode::Polling;
+                loggerThread = std::thread(&ActivityLogger::pollingLoop, this);
+            }
         }
     }
 
     void stop() {
         if (running) {
             running = false;
+            if (trackingMode == TrackingMode::Events) {
+                removeEventHooks();
+            }
+            SetEvent(pollWakeEvent);
             if (loggerThread.joinable()) {
                 loggerThread.join();
             }
+            completeStartup();
+            
+            // A clean stop ends the open segment here rather than leaving it
+            // to journal recovery
+            if (!wasIdle) {
+                goIdle(std::chrono::steady_clock::now());
+            }
+            pipeline.flush();
         }
     }
 
@@ -356,6 +813,7 @@ public:
     }
 
     void openLogFolder() {
+        if (!startupDone) return;
         std::string folder = logPath.substr(0, logPath.find_last_of("\\/"));
         ShellExecuteA(NULL, "open", folder.c_str(), NULL, NULL, SW_SHOWNORMAL);
     }
@@ -368,10 +826,203 @@ public:
         }
     }
 
+    // Opens the native viewer on the active log, falling back to the default
+    // CSV application if the file cannot be mapped
     void createLogViewer() {
-        // This would require a full Windows GUI implementation
-        // For brevity, just open the CSV file in default application
-        ShellExecuteA(NULL, "open", logPath.c_str(), NULL, NULL, SW_SHOWNORMAL);
+        if (!startupDone) {
+            MessageBoxA(NULL, "Still looking for the log folder; try again in a moment.", "Activity Logger", MB_OK | MB_ICONINFORMATION);
+            return;
+        }
+        if (!logFile) {
+            MessageBoxA(NULL, "This session is logged by the session host.", "Activity Logger", MB_OK | MB_ICONINFORMATION);
+            return;
+        }
+        pipeline.flush();
+        std::string activeLog = logFile->currentLogPath();
+        std::string csvPath = activeLog;
+        if (settings.logFormat == LogFormat::Binary) {
+            // Hand Excel a CSV rendering of the binary log
+            csvPath = segmentLogBase(activeLog) + "_Export.csv";
+            if (exportSegmentLogToCsv(segmentLogBase(activeLog), csvPath) < 0) {
+                MessageBoxA(NULL, "The binary log could not be exported.", "Activity Logger", MB_OK | MB_ICONERROR);
+                return;
+            }
+        }
+        
+        viewer = std::make_unique<LogViewer>();
+        std::wstring title = L"Activity Log - " + fromUtf8(csvPath.substr(csvPath.find_last_of("\\/") + 1));
+        if (viewer->open(csvPath, title, [this] { viewerOpen = false; viewerHwnd = nullptr; })) {
+            viewerHwnd = viewer->getHwnd();
+            viewerOpen = true;
+            return;
+        }
+        viewer.reset();
+        ShellExecuteA(NULL, "open", csvPath.c_str(), NULL, NULL, SW_SHOWNORMAL);
+    }
+
+    // Runs onMatch over the rows of the active log that overlap today, local
+    // time, through recentQuery. dayStart and now bound the range.
+    template <typename OnMatch>
+    bool queryToday(std::string& csvPath, int64_t& dayStart, int64_t& now, OnMatch&& onMatch) {
+        if (!startupDone) {
+            MessageBoxA(NULL, "Still looking for the log folder; try again in a moment.", "Activity Logger", MB_OK | MB_ICONINFORMATION);
+            return false;
+        }
+        if (!logFile) {
+            MessageBoxA(NULL, "This session is logged by the session host.", "Activity Logger", MB_OK | MB_ICONINFORMATION);
+            return false;
+        }
+        if (settings.logFormat == LogFormat::Binary) {
+            MessageBoxA(NULL, "Today's activity is only available for the CSV log format.", "Activity Logger", MB_OK | MB_ICONINFORMATION);
+            return false;
+        }
+        pipeline.flush();
+        csvPath = logFile->currentLogPath();
+        if (!recentQuery || recentQuery->getPath() != csvPath) {
+            recentQuery = std::make_unique<LogQuery>(csvPath);
+        }
+        
+        SYSTEMTIME local;
+        GetLocalTime(&local);
+        dayStart = csv_format_detail::daysFromCivil(local.wYear, local.wMonth, local.wDay) * 86400;
+        now = dayStart + local.wHour * 3600 + local.wMinute * 60 + local.wSecond + 1;
+        if (!recentQuery->queryRange(dayStart, now, LogQuery::AllCategories, onMatch)) {
+            MessageBoxA(NULL, "The log file could not be read.", "Activity Logger", MB_OK | MB_ICONERROR);
+            return false;
+        }
+        return true;
+    }
+
+    // Time per category since local midnight, segments clipped to today
+    void showTodaySummary() {
+        std::string csvPath;
+        int64_t dayStart, now;
+        std::map<std::string, int64_t> seconds;
+        bool ok = queryToday(csvPath, dayStart, now, [&](const LogQuery::Match& match) {
+            if (match.category == "Inactive") return;
+            seconds[std::string(match.category)] += std::min(match.end, now) - std::max(match.start, dayStart);
+        });
+        if (!ok) return;
+        
+        std::vector<std::pair<int64_t, std::string>> sorted;
+        int64_t total = 0;
+        for (const auto& entry : seconds) {
+            sorted.emplace_back(entry.second, entry.first);
+            total += entry.second;
+        }
+        std::sort(sorted.begin(), sorted.end(), std::greater<>());
+        
+        char line[64];
+        std::wstring text = L"Activity Logger - Today so far\n\n";
+        for (const auto& entry : sorted) {
+            snprintf(line, sizeof(line), ": %lldh %02lldm\n", static_cast<long long>(entry.first / 3600),
+                     static_cast<long long>(entry.first / 60 % 60));
+            text += fromUtf8(entry.second) + fromUtf8(line);
+        }
+        snprintf(line, sizeof(line), "\nTotal: %lldh %02lldm", static_cast<long long>(total / 3600),
+                 static_cast<long long>(total / 60 % 60));
+        text += fromUtf8(line);
+        MessageBoxW(NULL, text.c_str(), L"Activity Logger", MB_OK | MB_ICONINFORMATION);
+    }
+
+    // The viewer over only today's rows of the active log
+    void openTodayView() {
+        std::string csvPath;
+        int64_t dayStart, now;
+        std::vector<size_t> rows;
+        if (!queryToday(csvPath, dayStart, now, [&](const LogQuery::Match& match) { rows.push_back(match.row->offset); })) {
+            return;
+        }
+        if (rows.empty()) {
+            MessageBoxA(NULL, "Nothing has been logged today yet.", "Activity Logger", MB_OK | MB_ICONINFORMATION);
+            return;
+        }
+        
+        viewer = std::make_unique<LogViewer>();
+        std::wstring title = L"Activity Log - Today - " + fromUtf8(csvPath.substr(csvPath.find_last_of("\\/") + 1));
+        if (viewer->openRows(csvPath, std::move(rows), title, [this] { viewerOpen = false; viewerHwnd = nullptr; })) {
+            viewerHwnd = viewer->getHwnd();
+            viewerOpen = true;
+            return;
+        }
+        viewer.reset();
+        MessageBoxA(NULL, "The log file could not be opened.", "Activity Logger", MB_OK | MB_ICONERROR);
+    }
+
+    // The logger's own overhead since startup, from the stage timers and the
+    // process's CPU and memory counters
+    void showDiagnostics() {
+        const WriterStats& writer = writerStats();
+        double uptime = std::chrono::duration<double>(std::chrono::system_clock::now() - appStartTime).count();
+        char line[256];
+        std::string text = "Activity Logger - Diagnostics\n\n";
+        
+        snprintf(line, sizeof(line), "Uptime: %.0f s\nSamples: %llu\nSegments logged: %llu\n\n", uptime,
+                 static_cast<unsigned long long>(samplerStats.samples.get()),
+                 static_cast<unsigned long long>(samplerStats.segments.get()));
+        text += line;
+        appendStage(text, "Capture", samplerStats.capture);
+        appendStage(text, "Classify", samplerStats.classify);
+        appendStage(text, "Format (per batch)", writer.format);
+        appendStage(text, "Write (per batch)", writer.write);
+        
+        uint64_t hits = classifier.getCache().getHits(), misses = classifier.getCache().getMisses();
+        snprintf(line, sizeof(line),
+                 "\nClassification cache: %llu hits, %llu misses\n"
+                 "Rows written: %llu (%llu bytes)\nFailed writes: %llu\nDropped records: %llu\n"
+                 "Errors: %llu\nSteady-state allocations: %llu\n",
+                 static_cast<unsigned long long>(hits), static_cast<unsigned long long>(misses),
+                 static_cast<unsigned long long>(writer.records.get()),
+                 static_cast<unsigned long long>(writer.bytes.get()),
+                 static_cast<unsigned long long>(writer.failedWrites.get()),
+                 getDroppedRecords(),
+                 static_cast<unsigned long long>(samplerStats.errors.get()),
+                 static_cast<unsigned long long>(steadyStateAllocations));
+        text += line;
+        for (size_t i = 0; i < pipeline.sinkCount(); i++) {
+            snprintf(line, sizeof(line), "%s sink: %llu dropped\n", pipeline.sink(i).name(), pipeline.droppedRecords(i));
+            text += line;
+        }
+        if (forwarder) {
+            snprintf(line, sizeof(line), "Sent to session host: %llu records, %llu dropped while unreachable\n",
+                     static_cast<unsigned long long>(writer.records.get()),
+                     static_cast<unsigned long long>(forwarder->getDropped()));
+            text += line;
+        }
+        if (uploader) {
+            const UploadSink::Stats& upload = uploader->getStats();
+            snprintf(line, sizeof(line),
+                     "Uploads: %llu batches, %.1f KB sent from %.1f KB, %llu failed, %llu spooled, %llu dropped\n",
+                     static_cast<unsigned long long>(upload.batches.get()), upload.sentBytes.get() / 1024.0,
+                     upload.rawBytes.get() / 1024.0, static_cast<unsigned long long>(upload.failures.get()),
+                     static_cast<unsigned long long>(upload.spooled.load()),
+                     static_cast<unsigned long long>(upload.droppedBatches.get()));
+            text += line;
+        }
+        
+        double staged = samplerStats.capture.totalSeconds() + samplerStats.classify.totalSeconds() +
+                        writer.format.totalSeconds() + writer.write.totalSeconds();
+        snprintf(line, sizeof(line), "\nTime in logging stages: %.3f s (%.4f%% of uptime)\n",
+                 staged, uptime > 0 ? staged * 100.0 / uptime : 0.0);
+        text += line;
+        
+        FILETIME created, exited, kernel, user;
+        if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+            auto seconds = [](const FILETIME& time) {
+                return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+            };
+            double cpu = seconds(kernel) + seconds(user);
+            snprintf(line, sizeof(line), "Process CPU time: %.2f s (%.4f%% of uptime)\n",
+                     cpu, uptime > 0 ? cpu * 100.0 / uptime : 0.0);
+            text += line;
+        }
+        PROCESS_MEMORY_COUNTERS memory = {};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) {
+            snprintf(line, sizeof(line), "Working set: %.1f MB\n", memory.WorkingSetSize / (1024.0 * 1024.0));
+            text += line;
+        }
+        
+        MessageBoxA(NULL, text.c_str(), "Activity Logger Diagnostics", MB_OK | MB_ICONINFORMATION);
     }
 
     void showHelp() {
@@ -383,16 +1034,18 @@ public:
             "Restart Logging: Stops and restarts logging\n"
             "Open Log File: Opens the activity log\n"
             "Open Folder: Opens log file location\n"
+            "Diagnostics: Shows what the logger itself costs\n"
             "Help: Shows this help\n"
             "Exit: Closes the application\n\n"
-            "Log Location: " + logPath + "\n\n"
+            "Log Location: " + (startupDone ? logPath : std::string("(starting)")) + "\n\n"
             "The CSV can be analyzed with Excel or Power BI.";
             
         MessageBoxA(NULL, helpText.c_str(), "Activity Logger Help", MB_OK | MB_ICONINFORMATION);
     }
 
-    // Tray icon management
-    void createTrayIcon(HWND hwnd) {
+    // Tray icon management. The window comes first so timers and startup
+    // notifications work; the icon follows once the message loop runs.
+    void attachWindow(HWND hwnd) {
         this->hwnd = hwnd;
         
         ZeroMemory(&nid, sizeof(NOTIFYICONDATA));
@@ -405,8 +1058,16 @@ public:
         
         // Fix: Use lstrcpynA for ANSI or lstrcpynW for Unicode
         lstrcpynW(nid.szTip, L"Activity Logger", sizeof(nid.szTip) / sizeof(wchar_t));
-        
-        Shell_NotifyIcon(NIM_ADD, &nid);
+    }
+
+    // Also when Explorer restarts (TaskbarCreated), which drops every icon
+    void addTrayIcon() {
+        trayAdded = Shell_NotifyIcon(NIM_ADD, &nid) != FALSE;
+    }
+
+    void createTrayIcon() {
+        addTrayIcon();
+        if (hMenu) return;
         
         // Create context menu - use ANSI versions
         hMenu = CreatePopupMenu();
@@ -415,21 +1076,85 @@ public:
         AppendMenuA(hMenu, MF_STRING, 1003, "Restart Logging");
         AppendMenuA(hMenu, MF_SEPARATOR, 0, NULL);
         AppendMenuA(hMenu, MF_STRING, 1004, "Open Log File");
+        AppendMenuA(hMenu, MF_STRING, 1010, "Today's Activity");
+        AppendMenuA(hMenu, MF_STRING, 1009, "Today So Far");
         AppendMenuA(hMenu, MF_STRING, 1005, "Open Folder");
+        AppendMenuA(hMenu, MF_STRING, 1008, "Diagnostics");
         AppendMenuA(hMenu, MF_SEPARATOR, 0, NULL);
         AppendMenuA(hMenu, MF_STRING, 1006, "Help");
         AppendMenuA(hMenu, MF_STRING, 1007, "Exit");
     }
 
     void destroyTrayIcon() {
-        Shell_NotifyIcon(NIM_DELETE, &nid);
+        if (trayAdded) {
+            Shell_NotifyIcon(NIM_DELETE, &nid);
+            trayAdded = false;
+        }
         if (hMenu) {
             DestroyMenu(hMenu);
+            hMenu = nullptr;
+        }
+    }
+
+    static void appendDuration(std::wstring& text, int64_t seconds) {
+        wchar_t buffer[32];
+        swprintf(buffer, sizeof(buffer) / sizeof(wchar_t), L"%lldh %02lldm",
+                 static_cast<long long>(seconds / 3600), static_cast<long long>(seconds / 60 % 60));
+        text += buffer;
+    }
+
+    // Shows today's and this week's active time (everything but Inactive)
+    // and today's top category, straight from the running totals
+    void updateTrayTooltip() {
+        if (!startupDone || !totals) {
+            lstrcpynW(nid.szTip, agentMode ? L"Activity Logger\nLogged by the session host" : L"Activity Logger\nStarting",
+                      sizeof(nid.szTip) / sizeof(wchar_t));
+            nid.uFlags = NIF_TIP;
+            Shell_NotifyIcon(NIM_MODIFY, &nid);
+            nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
+            return;
+        }
+        const ActivityAggregates& aggregates = totals->getAggregates();
+        int32_t today = ActivityAggregates::todayKey();
+        auto todayTotals = aggregates.totals(ActivityAggregates::Kind::Category, today, today);
+        auto weekTotals = aggregates.totals(ActivityAggregates::Kind::Category, ActivityAggregates::weekStartKey(), today);
+
+        int64_t todaySeconds = 0, weekSeconds = 0;
+        const std::pair<std::string, ActivityAggregates::Totals>* top = nullptr;
+        for (const auto& entry : todayTotals) {
+            if (entry.first == "Inactive") continue;
+            todaySeconds += entry.second.seconds;
+            if (!top) top = &entry;
+        }
+        for (const auto& entry : weekTotals) {
+            if (entry.first != "Inactive") weekSeconds += entry.second.seconds;
         }
+
+        std::wstring tip = L"Activity Logger\nToday: ";
+        appendDuration(tip, todaySeconds);
+        if (top) {
+            tip += L" (" + fromUtf8(top->first) + L" ";
+            appendDuration(tip, top->second.seconds);
+            tip += L")";
+        }
+        tip += L"\nThis week: ";
+        appendDuration(tip, weekSeconds);
+
+        lstrcpynW(nid.szTip, tip.c_str(), sizeof(nid.szTip) / sizeof(wchar_t));
+        nid.uFlags = NIF_TIP;
+        Shell_NotifyIcon(NIM_MODIFY, &nid);
+        nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
     }
 
     void handleTrayMessage(WPARAM wParam, LPARAM lParam) {
-        if (lParam == WM_RBUTTONUP) {
+        if (lParam == WM_MOUSEMOVE) {
+            // Hovering sends a stream of these; the totals change slowly
+            ULONGLONG now = GetTickCount64();
+            if (now - tooltipUpdatedAt >= 5000) {
+                tooltipUpdatedAt = now;
+                updateTrayTooltip();
+            }
+        } else if (lParam == WM_RBUTTONUP) {
             POINT pt;
             GetCursorPos(&pt);
             SetForegroundWindow(hwnd);
@@ -451,6 +1176,9 @@ public:
             case 1004: openLogViewer(); break;
             case 1005: openLogFolder(); break;
             case 1006: showHelp(); break;
+            case 1008: showDiagnostics(); break;
+            case 1009: showTodaySummary(); break;
+            case 1010: openTodayView(); break;
             case 1007: 
                 stop();
                 PostQuitMessage(0);
@@ -459,14 +1187,72 @@ public:
     }
 
     bool isRunning() const { return running; }
+    
+    // Classification memo effectiveness, for sizing ClassificationCache::Slots
+    uint64_t getClassificationCacheHits() const { return classifier.getCache().getHits(); }
+    uint64_t getClassificationCacheMisses() const { return classifier.getCache().getMisses(); }
+    
+    // Heap allocations made by samples that did not change the segment;
+    // stays 0 unless built with ACTIVITYLOGGER_COUNT_ALLOCATIONS
+    uint64_t getSteadyStateAllocations() const { return steadyStateAllocations; }
+    
+    const SamplerStats& getSamplerStats() const { return samplerStats; }
+    const WriterStats& getWriterStats() const { return writerStats(); }
+    unsigned long long getDroppedRecords() const { return pipeline.droppedRecords() + earlyDropped; }
+    
+#ifdef ACTIVITYLOGGER_REPLAY
+    // Replay benchmark hooks (see ReplayBenchmark.h): the polling loop's work
+    // at a synthetic time, against desktop::replayState
+    void replayBegin(const std::chrono::steady_clock::time_point& when) {
+        startTime = Timestamp::at(when);
+        resetToForeground();
+        wasIdle = false;
+    }
+    
+    void replaySample(const std::chrono::steady_clock::time_point& when) {
+        onActivitySample(when);
+        checkIdle(when);
+    }
+    
+    // Closes the open segment and waits for the writer
+    void replayEnd(const std::chrono::steady_clock::time_point& when) {
+        if (!wasIdle) {
+            goIdle(when);
+        }
+        pipeline.flush();
+    }
+#endif
 };
 
+ActivityLogger* ActivityLogger::hookOwner = nullptr;
+
 // Global instance
 std::unique_ptr<ActivityLogger> g_logger;
 
 // Window procedure
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    static const UINT taskbarCreated = RegisterWindowMessageW(L"TaskbarCreated");
+    if (uMsg == taskbarCreated && taskbarCreated != 0) {
+        if (g_logger) {
+            g_logger->addTrayIcon();
+        }
+        return 0;
+    }
+    
     switch (uMsg) {
+        case WM_LOGGER_TRAY:
+            if (g_logger) {
+                g_logger->createTrayIcon();
+            }
+            return 0;
+            
+        case WM_LOGGER_STARTUP:
+            if (g_logger) {
+                g_logger->handleStartupReady();
+            }
+            return 0;
+            
+
         case WM_USER + 1: // Tray icon message
             if (g_logger) {
                 g_logger->handleTrayMessage(wParam, lParam);
@@ -479,7 +1265,26 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             }
             return 0;
             
+        case WM_TIMER:
+            if (g_logger) {
+                g_logger->handleTimer(wParam);
+            }
+            return 0;
+            
+        case WM_WTSSESSION_CHANGE:
+            if (g_logger) {
+                g_logger->handleSessionChange(wParam);
+            }
+            return 0;
+            
+        case WM_POWERBROADCAST:
+            if (g_logger) {
+                g_logger->handlePowerBroadcast(wParam);
+            }
+            return TRUE;
+            
         case WM_DESTROY:
+            WTSUnRegisterSessionNotification(hwnd);
             if (g_logger) {
                 g_logger->destroyTrayIcon();
                 g_logger->stop();
@@ -491,7 +1296,300 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
+// Command-line arguments arrive as UTF-16; the file APIs used here are ANSI
+static std::string narrowArg(const wchar_t* arg) {
+    int length = WideCharToMultiByte(CP_ACP, 0, arg, -1, NULL, 0, NULL, NULL);
+    if (length <= 1) return "";
+    std::string result(length - 1, '\0');
+    WideCharToMultiByte(CP_ACP, 0, arg, -1, &result[0], length, NULL, NULL);
+    return result;
+}
+
+// Output for command-line modes goes to the console we were started from
+static void consolePrint(const std::string& text) {
+    static bool attached = AttachConsole(ATTACH_PARENT_PROCESS) != 0;
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (attached && out && out != INVALID_HANDLE_VALUE) {
+        DWORD written;
+        WriteFile(out, text.data(), static_cast<DWORD>(text.size()), &written, NULL);
+    }
+}
+
+// "YYYY-MM-DD HH:MM:SS" or a bare "YYYY-MM-DD", which as the end of a range
+// includes that whole day
+static bool parseQueryTime(const std::string& text, bool rangeEnd, int64_t& seconds) {
+    if (csv_format_detail::parseTimestamp(text, seconds)) return true;
+    if (text.size() != 10 || !csv_format_detail::parseTimestamp(text + " 00:00:00", seconds)) return false;
+    if (rangeEnd) seconds += 86400;
+    return true;
+}
+
+static HANDLE hostStopEvent = nullptr;
+
+static BOOL WINAPI stopHostOnCtrl(DWORD) {
+    SetEvent(hostStopEvent);
+    return TRUE;
+}
+
+// Handles the command-line tools. Returns the process exit code, or -1 when
+// no tool was requested and the tray application should start (as a
+// session host agent with --agent).
+//
+//   ActivityLogger.exe --export-csv <log.seg | partition.cold> [out.csv]
+//   ActivityLogger.exe --report <folder> [out.csv] [--threads N] [--from T] [--to T]
+//   ActivityLogger.exe --query <log.csv | partition.cold | folder> <from> <to> [out.csv] [--category Name]...
+//                                         (one-shot scan; the tray keeps its index live)
+//   ActivityLogger.exe --service          (session host, under the SCM)
+//   ActivityLogger.exe --host [folder]    (session host in a console, until Ctrl+C;
+//                                          agents only trust one run as LocalSystem)
+//   ActivityLogger.exe --agent
+static int runCommandLine(bool& agentMode) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return -1;
+    
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        args.push_back(narrowArg(argv[i]));
+    }
+    LocalFree(argv);
+    
+    if (args.empty()) return -1;
+    
+    if (args[0] == "--export-csv") {
+        if (args.size() < 2) {
+            consolePrint("Usage: ActivityLogger.exe --export-csv <log.seg | partition.cold> [out.csv]\n");
+            return 2;
+        }
+        std::string base = segmentLogBase(args[1]);
+        std::string csvPath = args.size() >= 3 ? args[2] : base + "_Export.csv";
+        long long rows = isColdLogPath(args[1]) ? exportColdLogToCsv(args[1], csvPath)
+                                                : exportSegmentLogToCsv(base, csvPath);
+        if (rows < 0) {
+            consolePrint("Export failed: " + args[1] + "\n");
+            return 1;
+        }
+        consolePrint("Exported " + std::to_string(rows) + " rows to " + csvPath + "\n");
+        return 0;
+    }
+    
+    if (args[0] == "--report") {
+        std::vector<std::string> positional;
+        unsigned threads = 0;
+        int64_t from = INT64_MIN, to = INT64_MAX;
+        bool rangeOk = true;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--threads" && i + 1 < args.size()) {
+                threads = static_cast<unsigned>(std::strtoul(args[++i].c_str(), nullptr, 10));
+            } else if (args[i] == "--from" && i + 1 < args.size()) {
+                rangeOk = parseQueryTime(args[++i], false, from) && rangeOk;
+            } else if (args[i] == "--to" && i + 1 < args.size()) {
+                rangeOk = parseQueryTime(args[++i], true, to) && rangeOk;
+            } else {
+                positional.push_back(args[i]);
+            }
+        }
+        if (positional.empty() || !rangeOk) {
+            consolePrint("Usage: ActivityLogger.exe --report <folder> [out.csv] [--threads N] [--from T] [--to T]\n"
+                         "       times as YYYY-MM-DD or \"YYYY-MM-DD HH:MM:SS\", local\n");
+            return 2;
+        }
+        std::string folder = positional[0];
+        std::string outPath = positional.size() >= 2 ? positional[1] : folder + "\\ActivityReport.csv";
+        
+        ULONGLONG began = GetTickCount64();
+        LogReportSummary summary;
+        if (!writeLogReport(folder, outPath, threads, summary, from, to)) {
+            consolePrint("Report failed: no *_ActivityLog*.csv in " + folder + " or " + outPath + " not writable\n");
+            return 1;
+        }
+        consolePrint("Report of " + std::to_string(summary.machines) + " machines, " +
+                     std::to_string(summary.files) + " files, " + std::to_string(summary.rows) + " rows written to " +
+                     outPath + " in " + std::to_string(GetTickCount64() - began) + " ms\n");
+        if (summary.badRows || summary.failedFiles) {
+            consolePrint("Skipped " + std::to_string(summary.badRows) + " malformed rows and " +
+                         std::to_string(summary.failedFiles) + " unreadable files\n");
+        }
+        if (summary.skippedFiles) {
+            consolePrint(std::to_string(summary.skippedFiles) + " compacted files were outside the range\n");
+        }
+        return 0;
+    }
+    
+    if (args[0] == "--query") {
+        std::vector<std::string> positional;
+        std::vector<std::string> categories;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--category" && i + 1 < args.size()) {
+                categories.push_back(args[++i]);
+            } else {
+                positional.push_back(args[i]);
+            }
+        }
+        int64_t from, to;
+        if (positional.size() < 3 || !parseQueryTime(positional[1], false, from) ||
+            !parseQueryTime(positional[2], true, to)) {
+            consolePrint("Usage: ActivityLogger.exe --query <log.csv | partition.cold | folder> <from> <to> [out.csv]\n"
+                         "                           [--category Name]...\n"
+                         "       times as YYYY-MM-DD or \"YYYY-MM-DD HH:MM:SS\", local\n");
+            return 2;
+        }
+        
+        HANDLE out = INVALID_HANDLE_VALUE;
+        if (positional.size() >= 4) {
+            out = CreateFileA(positional[3].c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+            if (out == INVALID_HANDLE_VALUE) {
+                consolePrint("Cannot write " + positional[3] + "\n");
+                return 1;
+            }
+        }
+        auto emit = [&](const std::string& text) {
+            if (out != INVALID_HANDLE_VALUE) {
+                segment_log_detail::writeAll(out, text.data(), text.size());
+            } else {
+                consolePrint(text);
+            }
+        };
+        
+        // A folder stands for every log in it, partitions and cold files
+        // included, in name order
+        std::vector<std::string> files;
+        DWORD attributes = GetFileAttributesA(positional[0].c_str());
+        if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            std::string directory = positional[0];
+            if (directory.back() != '\\' && directory.back() != '/') directory += '\\';
+            for (const char* pattern : { "*_ActivityLog*.csv", "*_ActivityLog*.cold" }) {
+                WIN32_FIND_DATAA found;
+                HANDLE search = FindFirstFileA((directory + pattern).c_str(), &found);
+                if (search == INVALID_HANDLE_VALUE) continue;
+                do {
+                    if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+                        !log_report_detail::machineOf(found.cFileName).empty()) {
+                        files.push_back(directory + found.cFileName);
+                    }
+                } while (FindNextFileA(search, &found));
+                FindClose(search);
+            }
+            std::sort(files.begin(), files.end());
+        } else {
+            files.push_back(positional[0]);
+        }
+        
+        std::string text = CsvHeader;
+        uint64_t rows = 0;
+        unsigned skipped = 0;
+        auto flushIfLarge = [&] {
+            if (text.size() >= 1024 * 1024) {
+                emit(text);
+                text.clear();
+            }
+        };
+        bool opened = !files.empty();
+        for (const auto& file : files) {
+            if (isColdLogPath(file)) {
+                // The header's min/max rule most compacted months out unread
+                ColdLogHeader header;
+                if (!ColdLogReader::readHeader(file, header)) {
+                    opened = false;
+                    continue;
+                }
+                if (!ColdLogReader::mayOverlap(header, from, to)) {
+                    skipped++;
+                    continue;
+                }
+                ColdLogReader reader;
+                if (!reader.open(file)) {
+                    opened = false;
+                    continue;
+                }
+                ColdRow row;
+                while (reader.next(row)) {
+                    if (row.start >= to || row.start + row.duration <= from) continue;
+                    if (!categories.empty() &&
+                        std::find(categories.begin(), categories.end(), row.category) == categories.end()) {
+                        continue;
+                    }
+                    ColdLogReader::appendCsv(text, row);
+                    rows++;
+                    flushIfLarge();
+                }
+                continue;
+            }
+            LogQuery query(file);
+            uint64_t mask = LogQuery::AllCategories;
+            for (const auto& category : categories) {
+                mask |= query.categoryBit(category);
+            }
+            opened = query.queryRange(from, to, mask, [&](const LogQuery::Match& match) {
+                text.append(match.raw.data(), match.raw.size());
+                rows++;
+                flushIfLarge();
+            }) && opened;
+        }
+        emit(text);
+        if (out != INVALID_HANDLE_VALUE) {
+            CloseHandle(out);
+            consolePrint("Wrote " + std::to_string(rows) + " rows to " + positional[3] + "\n");
+        }
+        if (skipped) {
+            consolePrint(std::to_string(skipped) + " compacted files were outside the range\n");
+        }
+        if (!opened) {
+            consolePrint("Cannot open all of " + positional[0] + "\n");
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (args[0] == "--service") {
+        if (!runSessionHostService(sessionHostFolder())) {
+            consolePrint("--service only runs under the service control manager; try --host\n");
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (args[0] == "--host") {
+        std::string folder = args.size() >= 2 ? args[1] : sessionHostFolder();
+        if (folder.back() != '\\' && folder.back() != '/') folder += '\\';
+        SessionHost host(folder);
+        hostStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        SetConsoleCtrlHandler(stopHostOnCtrl, TRUE);
+        consolePrint("Session host logging to " + folder + "; agents connect with --agent. Ctrl+C stops.\n");
+        bool served = host.run(hostStopEvent);
+        CloseHandle(hostStopEvent);
+        if (!served) {
+            consolePrint("Could not create the session host pipe; is another host running?\n");
+            return 1;
+        }
+        consolePrint("Received " + std::to_string(host.recordsReceived()) + " segments, rejected " +
+                     std::to_string(host.messagesRejected()) + " messages\n");
+        return 0;
+    }
+    
+    if (args[0] == "--agent") {
+        agentMode = true;
+    }
+    return -1;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    bool agentMode = false;
+    int toolResult = runCommandLine(agentMode);
+    if (toolResult >= 0) {
+        return toolResult;
+    }
+    
+    // The session host starts an agent at every sign-in; one per session
+    HANDLE agentMutex = nullptr;
+    if (agentMode) {
+        agentMutex = CreateMutexW(NULL, FALSE, L"Local\\ActivityLoggerAgent");
+        if (GetLastError() == ERROR_ALREADY_EXISTS) {
+            return 0;
+        }
+    }
+    
     // Register window class
     WNDCLASSEX wc = {};
     wc.cbSize = sizeof(WNDCLASSEX);
@@ -512,9 +1610,17 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
     
     // Create logger instance
-    g_logger = std::make_unique<ActivityLogger>();
-    g_logger->createTrayIcon(hwnd);
+    // Sampling starts first; the log folder is found in the background and
+    // the tray icon is added from the message loop
+    g_logger = std::make_unique<ActivityLogger>(std::string(), agentMode);
+    g_logger->attachWindow(hwnd);
+    registerStatsTrace();
     g_logger->start();
+    PostMessage(hwnd, WM_LOGGER_TRAY, 0, 0);
+    
+    // Lock/unlock arrive as WM_WTSSESSION_CHANGE; suspend/resume are
+    // broadcast to every top-level window as WM_POWERBROADCAST
+    WTSRegisterSessionNotification(hwnd, NOTIFY_FOR_THIS_SESSION);
     
     // Message loop
     MSG msg;
@@ -525,6 +1631,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     
     // Cleanup
     g_logger.reset();
+    unregisterStatsTrace();
+    if (agentMutex) {
+        CloseHandle(agentMutex);
+    }
     
     return 0;
-}
\ No newline at end of file
+}
+
+#ifdef ACTIVITYLOGGER_REPLAY
+#include "ReplayBenchmark.h"
+#endif
\ No newline at end of file
@@ -22,17 +22,19 @@ LIBPATHS = /LIBPATH:"$(VSINSTALLDIR)\VC\Tools\MSVC\14.44.35211\lib\x64" \
            /LIBPATH:"$(WINDOWSSDKDIR)\Lib\10.0.22621.0\ucrt\x64"
 
 # Compiler flags
-CFLAGS = /EHsc /W3 /MD /O2 /DWIN32 /D_WINDOWS /DUNICODE /D_UNICODE $(INCLUDES)
+CFLAGS = /std:c++17 /EHsc /W3 /MD /O2 /DWIN32 /D_WINDOWS /DUNICODE /D_UNICODE $(INCLUDES)
 
 # Linker flags and libraries
 LDFLAGS = /SUBSYSTEM:WINDOWS /ENTRY:wWinMainCRTStartup $(LIBPATHS)
-LIBS = user32.lib psapi.lib shell32.lib comctl32.lib comdlg32.lib kernel32.lib
+LIBS = user32.lib psapi.lib shell32.lib comctl32.lib comdlg32.lib kernel32.lib winhttp.lib cabinet.lib ole32.lib oleaut32.lib advapi32.lib userenv.lib wtsapi32.lib
 
 # Target executable
 TARGET = ActivityLogger.exe
 
 # Source files
 SOURCES = ActivityLogger.cpp
+HEADERS = ActivityAggregates.h AllocationCounter.h BrowserSites.h CategoryMatcher.h CategoryRules.h ClassificationCache.h ColdStorage.h CsvFormat.h CsvReader.h Desktop.h ForegroundCapture.h HostLink.h LogPartitions.h LoggerStats.h LogQuery.h LogReport.h LogViewer.h LogWriter.h \
+          ReplayBenchmark.h SamplingScheduler.h SegmentClassifier.h SegmentCoalescer.h SegmentJournal.h SegmentLog.h SegmentSink.h SessionHost.h Settings.h SpscRing.h StringPool.h Timestamp.h UploadSink.h Utf8.h
 
 # Object files
 OBJECTS = ActivityLogger.obj
@@ -45,7 +47,7 @@ $(TARGET): $(OBJECTS)
     $(LINK) $(LDFLAGS) $(OBJECTS) $(LIBS) /OUT:$(TARGET)
 
 # Compile source files
-ActivityLogger.obj: ActivityLogger.cpp
+ActivityLogger.obj: ActivityLogger.cpp $(HEADERS)
     $(CC) $(CFLAGS) /c ActivityLogger.cpp
 
 # Clean target
@@ -57,10 +59,29 @@ clean:
 
 # Debug build
 debug:
-    $(CC) /EHsc /W3 /MDd /Od /Zi /DWIN32 /D_WINDOWS /DUNICODE /D_UNICODE /D_DEBUG $(INCLUDES) /c ActivityLogger.cpp
+    $(CC) /std:c++17 /EHsc /W3 /MDd /Od /Zi /DWIN32 /D_WINDOWS /DUNICODE /D_UNICODE /D_DEBUG $(INCLUDES) /c ActivityLogger.cpp
     $(LINK) /SUBSYSTEM:WINDOWS /ENTRY:wWinMainCRTStartup /DEBUG $(LIBPATHS) $(OBJECTS) $(LIBS) /OUT:$(TARGET)
 
+# Release build that counts heap allocations on the sampling path
+# (see AllocationCounter.h and ActivityLogger::getSteadyStateAllocations)
+alloccheck:
+    $(CC) $(CFLAGS) /DACTIVITYLOGGER_COUNT_ALLOCATIONS /c ActivityLogger.cpp
+    $(LINK) $(LDFLAGS) $(OBJECTS) $(LIBS) /OUT:$(TARGET)
+
+# Release build that also emits the Diagnostics counters as TraceLogging
+# (ETW) events from the ActivityLogger provider (see LoggerStats.h)
+tracelogging:
+    $(CC) $(CFLAGS) /DACTIVITYLOGGER_TRACELOGGING /c ActivityLogger.cpp
+    $(LINK) $(LDFLAGS) $(OBJECTS) $(LIBS) advapi32.lib /OUT:$(TARGET)
+
+# Console replay benchmark: pushes a recorded log or a synthetic trace
+# through the real sampling path and reports ns, allocations and bytes per
+# event (see ReplayBenchmark.h). Run ActivityLoggerBench.exe --help for options.
+bench: ActivityLogger.cpp $(HEADERS)
+    $(CC) $(CFLAGS) /DACTIVITYLOGGER_REPLAY /DACTIVITYLOGGER_COUNT_ALLOCATIONS /c ActivityLogger.cpp /FoActivityLoggerBench.obj
+    $(LINK) /SUBSYSTEM:CONSOLE $(LIBPATHS) ActivityLoggerBench.obj $(LIBS) /OUT:ActivityLoggerBench.exe
+
 # Rebuild target
 rebuild: clean all
 
-.PHONY: all clean debug rebuild
\ No newline at end of file
+.PHONY: all clean debug alloccheck tracelogging bench rebuild
\ No newline at end of file
@@ -0,0 +1,54 @@
+// AllocationCounter.h
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Test hook for the allocation-free sampling path. Building with
+// /DACTIVITYLOGGER_COUNT_ALLOCATIONS (nmake alloccheck) replaces the global
+// operator new with one that counts allocations per thread; otherwise the
+// counter always reads 0 and costs nothing.
+//
+// The replacement operators are not inline, so include this header from
+// exactly one translation unit per executable.
+
+#ifdef ACTIVITYLOGGER_COUNT_ALLOCATIONS
+
+namespace allocation_counter {
+inline thread_local uint64_t threadAllocations = 0;
+}
+
+void* operator new(size_t size) {
+    allocation_counter::threadAllocations++;
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    allocation_counter::threadAllocations++;
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    allocation_counter::threadAllocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    allocation_counter::threadAllocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+void operator delete[](void* block, size_t) noexcept { std::free(block); }
+
+inline uint64_t threadAllocationCount() { return allocation_counter::threadAllocations; }
+
+#else
+
+inline uint64_t threadAllocationCount() { return 0; }
+
+#endif
@@ -0,0 +1,319 @@
+// BrowserSites.h
+#pragma once
+#include <windows.h>
+#include <ole2.h>
+#include <uiautomation.h>
+#include <atomic>
+#include <cwchar>
+#include <cwctype>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "oleaut32.lib")
+
+// Site shown in a browser's address bar, in fixed storage like TitleBuffer
+struct SiteBuffer {
+    static constexpr int Capacity = 256;
+    wchar_t text[Capacity];
+    int length = 0;
+
+    std::wstring_view view() const { return std::wstring_view(text, length); }
+    bool empty() const { return length == 0; }
+    void clear() { length = 0; }
+};
+
+namespace browser_sites_detail {
+
+// "https://www.github.com:443/x" and "github.com/x" -> "github.com". Empty
+// for anything that does not look like a web address (about:blank, search
+// text being typed, file URLs).
+inline std::wstring_view siteOf(std::wstring_view url) {
+    size_t scheme = url.find(L"://");
+    if (scheme != std::wstring_view::npos) url.remove_prefix(scheme + 3);
+    url = url.substr(0, url.find_first_of(L"/?#"));
+    size_t at = url.rfind(L'@');
+    if (at != std::wstring_view::npos) url.remove_prefix(at + 1);
+    url = url.substr(0, url.find(L':'));
+    if (url.size() > 4 && url.compare(0, 4, L"www.") == 0) url.remove_prefix(4);
+    if (url.empty() || url.size() >= SiteBuffer::Capacity || url.find(L'.') == std::wstring_view::npos ||
+        url.find_first_of(L" \t") != std::wstring_view::npos) {
+        return std::wstring_view();
+    }
+    return url;
+}
+
+}
+
+// Reads the site of the active tab of Chrome, Edge and Firefox through UI
+// Automation, for use as a segment's details instead of a guess from the
+// title. Opt-in ([Details] BrowserSites=1).
+//
+// The sampling thread never makes a UIA call. lookup() copies the cached
+// site for the window under a short lock; a window that is not cached
+// yet is handed to a worker thread, which finds the address bar once,
+// caches the element and subscribes to its value changes, so navigating or
+// switching tabs updates the cache without any per-tick tree walks.
+class BrowserSiteProvider {
+private:
+    static constexpr size_t Slots = 8;
+    static constexpr ULONGLONG RetryMs = 5000;    // browsers build their UIA tree lazily
+
+    struct Slot {
+        // Guarded by slotsMutex
+        HWND hwnd = nullptr;
+        wchar_t site[SiteBuffer::Capacity];
+        int length = 0;
+        ULONGLONG triedAt = 0;
+        std::atomic<ULONGLONG> usedAt{ 0 };
+
+        // Worker thread only
+        IUIAutomationElement* element = nullptr;
+        IUIAutomationPropertyChangedEventHandler* handler = nullptr;
+    };
+
+    // Delivered on UIA's threads for one slot's address bar
+    class ValueHandler final : public IUIAutomationPropertyChangedEventHandler {
+    private:
+        std::atomic<ULONG> references;
+        BrowserSiteProvider* owner;
+        size_t slot;
+        HWND hwnd;
+
+    public:
+        ValueHandler(BrowserSiteProvider* provider, size_t index, HWND window)
+            : references(1), owner(provider), slot(index), hwnd(window) {}
+
+        ULONG STDMETHODCALLTYPE AddRef() override { return ++references; }
+
+        ULONG STDMETHODCALLTYPE Release() override {
+            ULONG left = --references;
+            if (left == 0) delete this;
+            return left;
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override {
+            if (riid == __uuidof(IUnknown) || riid == __uuidof(IUIAutomationPropertyChangedEventHandler)) {
+                *object = static_cast<IUIAutomationPropertyChangedEventHandler*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *object = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        HRESULT STDMETHODCALLTYPE HandlePropertyChangedEvent(IUIAutomationElement*, PROPERTYID property,
+                                                             VARIANT value) override {
+            if (property == UIA_ValueValuePropertyId && value.vt == VT_BSTR && value.bstrVal) {
+                owner->store(slot, hwnd, std::wstring_view(value.bstrVal, SysStringLen(value.bstrVal)));
+            }
+            return S_OK;
+        }
+    };
+
+    Slot slots[Slots];
+    std::mutex slotsMutex;
+
+    std::thread worker;
+    HANDLE wakeEvent;
+    std::atomic<bool> stopping;
+    std::atomic<HWND> wanted;
+
+    // Worker thread only
+    IUIAutomation* automation;
+
+    // A value that is not an address (text being typed) keeps the last site
+    void store(size_t index, HWND hwnd, std::wstring_view url) {
+        std::wstring_view site = browser_sites_detail::siteOf(url);
+        if (site.empty()) return;
+        std::lock_guard<std::mutex> lock(slotsMutex);
+        Slot& slot = slots[index];
+        if (slot.hwnd == hwnd) {
+            wmemcpy(slot.site, site.data(), site.size());
+            slot.length = static_cast<int>(site.size());
+        }
+    }
+
+    void release(Slot& slot) {
+        if (slot.handler) {
+            automation->RemovePropertyChangedEventHandler(slot.element, slot.handler);
+            slot.handler->Release();
+            slot.handler = nullptr;
+        }
+        if (slot.element) {
+            slot.element->Release();
+            slot.element = nullptr;
+        }
+    }
+
+    // The slot for hwnd if it has one, else a free, closed or least recently
+    // used one, taken over for hwnd. Either way this counts as an attempt, so
+    // lookup() asks again no sooner than RetryMs from now.
+    size_t claimSlot(HWND hwnd, bool& existing) {
+        size_t victim = 0;
+        existing = false;
+        for (size_t i = 0; i < Slots; i++) {
+            if (slots[i].hwnd == hwnd) {
+                std::lock_guard<std::mutex> lock(slotsMutex);
+                slots[i].triedAt = GetTickCount64();
+                existing = true;
+                return i;
+            }
+        }
+        for (size_t i = 0; i < Slots; i++) {
+            if (!slots[i].hwnd || !IsWindow(slots[i].hwnd)) {
+                victim = i;
+                break;
+            }
+            if (slots[i].usedAt.load(std::memory_order_relaxed) < slots[victim].usedAt.load(std::memory_order_relaxed)) {
+                victim = i;
+            }
+        }
+        std::lock_guard<std::mutex> lock(slotsMutex);
+        slots[victim].hwnd = hwnd;
+        slots[victim].length = 0;
+        slots[victim].triedAt = GetTickCount64();
+        return victim;
+    }
+
+    // Finds the address bar: the first edit control in the window's tree
+    IUIAutomationElement* findAddressBar(HWND hwnd) {
+        IUIAutomationElement* window = nullptr;
+        if (FAILED(automation->ElementFromHandle(hwnd, &window)) || !window) return nullptr;
+
+        IUIAutomationElement* found = nullptr;
+        IUIAutomationCondition* isEdit = nullptr;
+        VARIANT type;
+        VariantInit(&type);
+        type.vt = VT_I4;
+        type.lVal = UIA_EditControlTypeId;
+        if (SUCCEEDED(automation->CreatePropertyCondition(UIA_ControlTypePropertyId, type, &isEdit))) {
+            window->FindFirst(TreeScope_Descendants, isEdit, &found);
+            isEdit->Release();
+        }
+        window->Release();
+        return found;
+    }
+
+    void readValue(size_t index, HWND hwnd) {
+        VARIANT value;
+        VariantInit(&value);
+        if (SUCCEEDED(slots[index].element->GetCurrentPropertyValue(UIA_ValueValuePropertyId, &value))) {
+            if (value.vt == VT_BSTR && value.bstrVal) {
+                store(index, hwnd, std::wstring_view(value.bstrVal, SysStringLen(value.bstrVal)));
+            }
+            VariantClear(&value);
+        }
+    }
+
+    // A window whose address bar is already found and subscribed to is only
+    // missing a site (new tab page, typed search): the value is read again
+    // without another tree walk
+    void resolve(HWND hwnd) {
+        bool existing;
+        size_t index = claimSlot(hwnd, existing);
+        Slot& slot = slots[index];
+        if (existing && slot.element && slot.handler) {
+            readValue(index, hwnd);
+            return;
+        }
+        release(slot);
+
+        slot.element = findAddressBar(hwnd);
+        if (!slot.element) return;
+        readValue(index, hwnd);
+
+        ValueHandler* handler = new ValueHandler(this, index, hwnd);
+        PROPERTYID property = UIA_ValueValuePropertyId;
+        if (SUCCEEDED(automation->AddPropertyChangedEventHandlerNativeArray(slot.element, TreeScope_Element, NULL,
+                                                                           handler, &property, 1))) {
+            slot.handler = handler;
+        } else {
+            handler->Release();
+        }
+    }
+
+    void workerLoop() {
+        if (FAILED(CoInitializeEx(NULL, COINIT_MULTITHREADED))) return;
+        if (SUCCEEDED(CoCreateInstance(__uuidof(CUIAutomation), NULL, CLSCTX_INPROC_SERVER,
+                                       __uuidof(IUIAutomation), reinterpret_cast<void**>(&automation)))) {
+            while (WaitForSingleObject(wakeEvent, INFINITE) == WAIT_OBJECT_0 && !stopping) {
+                HWND hwnd = wanted.exchange(nullptr);
+                if (hwnd) resolve(hwnd);
+            }
+            for (auto& slot : slots) {
+                release(slot);
+            }
+            automation->Release();
+            automation = nullptr;
+        }
+        CoUninitialize();
+    }
+
+public:
+    BrowserSiteProvider() : wakeEvent(nullptr), stopping(false), wanted(nullptr), automation(nullptr) {}
+
+    ~BrowserSiteProvider() {
+        stop();
+    }
+
+    BrowserSiteProvider(const BrowserSiteProvider&) = delete;
+    BrowserSiteProvider& operator=(const BrowserSiteProvider&) = delete;
+
+    void start() {
+        if (worker.joinable()) return;
+        stopping = false;
+        wakeEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+        worker = std::thread(&BrowserSiteProvider::workerLoop, this);
+    }
+
+    void stop() {
+        if (!worker.joinable()) return;
+        stopping = true;
+        SetEvent(wakeEvent);
+        worker.join();
+        CloseHandle(wakeEvent);
+        wakeEvent = nullptr;
+    }
+
+    static bool isBrowser(std::wstring_view processName) {
+        static const wchar_t* const browsers[] = { L"chrome.exe", L"msedge.exe", L"firefox.exe" };
+        for (const wchar_t* browser : browsers) {
+            std::wstring_view name(browser);
+            if (processName.size() != name.size()) continue;
+            bool same = true;
+            for (size_t i = 0; i < name.size() && same; i++) {
+                same = static_cast<wchar_t>(towlower(processName[i])) == name[i];
+            }
+            if (same) return true;
+        }
+        return false;
+    }
+
+    // Sampling thread. Copies the cached site of hwnd's active tab into out
+    // (left empty until the worker has found the address bar).
+    void lookup(HWND hwnd, SiteBuffer& out) {
+        out.clear();
+        ULONGLONG now = GetTickCount64();
+        bool known = false;
+        bool retry = false;
+
+        {
+            std::lock_guard<std::mutex> lock(slotsMutex);
+            for (auto& slot : slots) {
+                if (slot.hwnd != hwnd) continue;
+                known = true;
+                wmemcpy(out.text, slot.site, slot.length);
+                out.length = slot.length;
+                retry = slot.length == 0 && now - slot.triedAt >= RetryMs;
+                slot.usedAt.store(now, std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        if ((!known || retry) && wanted.exchange(hwnd) != hwnd) {
+            SetEvent(wakeEvent);
+        }
+    }
+};
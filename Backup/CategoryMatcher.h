@@ -0,0 +1,255 @@
+// CategoryMatcher.h
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CsvFormat.h"
+#include "Utf8.h"
+
+// Category rules compiled into one Aho-Corasick automaton. Rules are
+// substring patterns matched case-insensitively against the process name,
+// window title and window details; when several match, the rule that comes
+// first wins. The automaton is a dense DFA over the UTF-16 code units that
+// actually occur in the patterns, so classifying is a single table walk per
+// field with no allocation however many rules are loaded.
+class CategoryMatcher {
+public:
+    struct Rule {
+        std::string pattern;
+        std::string category;
+    };
+
+    static constexpr int NoMatch = -1;
+
+private:
+    // UTF-16 code unit -> alphabet class; class 0 stands for every unit no
+    // pattern uses
+    std::vector<uint16_t> unitClass;
+    size_t alphabetSize;
+
+    // transitions[state * alphabetSize + class], complete (no failure links
+    // left to follow at match time)
+    std::vector<int32_t> transitions;
+
+    // Best (lowest) rule index recognised on reaching each state, including
+    // the rules inherited through the failure chain
+    std::vector<int32_t> stateRule;
+
+    std::vector<int32_t> ruleCategory;
+    std::vector<std::string> categories;
+
+    size_t classOf(wchar_t unit) const {
+        uint32_t code = static_cast<uint32_t>(unit);
+        return code < 0x10000 ? unitClass[code] : 0;
+    }
+
+    int scan(std::wstring_view text, int best) const {
+        int32_t state = 0;
+        for (size_t i = 0; i < text.size() && best != 0; i++) {
+            state = transitions[state * alphabetSize + classOf(text[i])];
+            int32_t rule = stateRule[state];
+            if (rule >= 0 && (best < 0 || rule < best)) best = rule;
+        }
+        return best;
+    }
+
+public:
+    // Lower-cased UTF-16, as patterns and rule keys are compared
+    static std::wstring foldCase(std::string_view utf8) {
+        std::wstring text = fromUtf8(utf8);
+        for (auto& unit : text) {
+            unit = static_cast<wchar_t>(std::towlower(unit));
+        }
+        return text;
+    }
+
+    CategoryMatcher() {
+        compile(std::vector<Rule>());
+    }
+
+    void compile(const std::vector<Rule>& rules) {
+        unitClass.assign(0x10000, uint16_t(0));
+        transitions.clear();
+        stateRule.clear();
+        ruleCategory.clear();
+        categories.clear();
+
+        // Patterns are UTF-8 in the rule file
+        std::vector<std::wstring> patterns;
+        for (const auto& rule : rules) {
+            patterns.push_back(foldCase(rule.pattern));
+        }
+
+        // Assign alphabet classes, folding case. Class 0 would match any
+        // unused unit, so a pattern left with a unit outside the classes
+        // (only possible past 65535 of them) is never entered in the trie.
+        size_t classes = 1;
+        for (const auto& pattern : patterns) {
+            for (wchar_t unit : pattern) {
+                uint32_t code = static_cast<uint32_t>(unit);
+                if (code >= 0x10000 || unitClass[code] != 0 || classes > 0xFFFF) continue;
+
+                unitClass[code] = static_cast<uint16_t>(classes++);
+                uint32_t upper = static_cast<uint32_t>(std::towupper(unit));
+                if (upper < 0x10000 && unitClass[upper] == 0) {
+                    unitClass[upper] = unitClass[code];
+                }
+            }
+        }
+        alphabetSize = classes;
+
+        // Trie
+        transitions.assign(alphabetSize, -1);
+        stateRule.assign(1, NoMatch);
+        for (size_t r = 0; r < rules.size(); r++) {
+            const Rule& rule = rules[r];
+
+            // Category names are shared between rules
+            auto it = std::find(categories.begin(), categories.end(), rule.category);
+            ruleCategory.push_back(static_cast<int32_t>(it - categories.begin()));
+            if (it == categories.end()) {
+                categories.push_back(rule.category);
+            }
+
+            if (patterns[r].empty()) continue;
+            bool classified = std::all_of(patterns[r].begin(), patterns[r].end(),
+                                          [this](wchar_t unit) { return classOf(unit) != 0; });
+            if (!classified) continue;
+
+            int32_t state = 0;
+            for (wchar_t unit : patterns[r]) {
+                size_t cls = classOf(unit);
+                int32_t next = transitions[state * alphabetSize + cls];
+                if (next < 0) {
+                    next = static_cast<int32_t>(stateRule.size());
+                    transitions[state * alphabetSize + cls] = next;
+                    transitions.resize(transitions.size() + alphabetSize, -1);
+                    stateRule.push_back(NoMatch);
+                }
+                state = next;
+            }
+            if (stateRule[state] == NoMatch) {
+                stateRule[state] = static_cast<int32_t>(r);
+            }
+        }
+
+        // Breadth-first pass turning the trie into a complete DFA
+        std::vector<int32_t> fail(stateRule.size(), 0);
+        std::queue<int32_t> pending;
+        for (size_t c = 0; c < alphabetSize; c++) {
+            int32_t& next = transitions[c];
+            if (next < 0) {
+                next = 0;
+            } else {
+                pending.push(next);
+            }
+        }
+        while (!pending.empty()) {
+            int32_t state = pending.front();
+            pending.pop();
+
+            int32_t inherited = stateRule[fail[state]];
+            if (inherited >= 0 && (stateRule[state] < 0 || inherited < stateRule[state])) {
+                stateRule[state] = inherited;
+            }
+
+            for (size_t c = 0; c < alphabetSize; c++) {
+                int32_t& next = transitions[state * alphabetSize + c];
+                int32_t fallback = transitions[fail[state] * alphabetSize + c];
+                if (next < 0) {
+                    next = fallback;
+                } else {
+                    fail[next] = fallback;
+                    pending.push(next);
+                }
+            }
+        }
+    }
+
+    // Returns the index of the category of the highest-priority rule found in
+    // any of the fields, or NoMatch
+    int match(std::wstring_view process, std::wstring_view title, std::wstring_view details) const {
+        int best = scan(process, NoMatch);
+        best = scan(title, best);
+        best = scan(details, best);
+        return best < 0 ? NoMatch : ruleCategory[best];
+    }
+
+    // UTF-8, as read from the rules
+    const std::string& categoryName(int index) const { return categories[index]; }
+    size_t categoryCount() const { return categories.size(); }
+    size_t stateCount() const { return stateRule.size(); }
+
+    // Built-in rules, in the priority order the original lookup table had
+    static std::vector<Rule> defaultRules() {
+        return {
+            {"chrome", "Web Browsing"},
+            {"cmd", "Terminal"},
+            {"code", "Development"},
+            {"excel", "Work - Office"},
+            {"firefox", "Web Browsing"},
+            {"msedge", "Web Browsing"},
+            {"notepad", "Notes"},
+            {"outlook", "Email"},
+            {"powerpnt", "Work - Office"},
+            {"powershell", "Terminal"},
+            {"slack", "Communication"},
+            {"teams", "Meetings"},
+            {"winword", "Work - Office"},
+            {"zoom", "Meetings"}
+        };
+    }
+};
+
+// Reads Key/Category rules from the ActivitySummary.csv maintained by the
+// Python config manager (core/config.py) and merges them over the defaults:
+// a known key takes the file's category, new keys follow in file order.
+inline std::vector<CategoryMatcher::Rule> loadCategoryRules(const std::string& path) {
+    std::vector<CategoryMatcher::Rule> rules = CategoryMatcher::defaultRules();
+
+    std::ifstream file(path);
+    if (!file.is_open()) return rules;
+
+    // Skip comment lines and find headers
+    std::string line;
+    int keyIndex = -1;
+    int categoryIndex = -1;
+    while (std::getline(file, line)) {
+        std::vector<std::string> headers = splitCsvLine(line);
+        if (headers.empty() || headers[0].empty() || headers[0][0] == '#') continue;
+
+        for (size_t i = 0; i < headers.size(); i++) {
+            std::string header = trimCopy(headers[i]);
+            if (header == "Key") keyIndex = static_cast<int>(i);
+            if (header == "Category") categoryIndex = static_cast<int>(i);
+        }
+        break;
+    }
+    if (keyIndex < 0 || categoryIndex < 0) return rules;
+
+    while (std::getline(file, line)) {
+        std::vector<std::string> row = splitCsvLine(line);
+        if (static_cast<int>(row.size()) <= std::max(keyIndex, categoryIndex)) continue;
+
+        std::string key = trimCopy(row[keyIndex]);
+        std::string category = trimCopy(row[categoryIndex]);
+        if (key.empty() || category.empty()) continue;
+
+        // compile() folds case, so keys differing only in case are one rule
+        std::wstring folded = CategoryMatcher::foldCase(key);
+        auto existing = std::find_if(rules.begin(), rules.end(), [&folded](const CategoryMatcher::Rule& rule) {
+            return CategoryMatcher::foldCase(rule.pattern) == folded;
+        });
+        if (existing != rules.end()) {
+            existing->category = category;
+        } else {
+            rules.push_back({ key, category });
+        }
+    }
+    return rules;
+}
@@ -0,0 +1,196 @@
+// CategoryRules.h
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CategoryMatcher.h"
+
+// The compiled category rules, reloaded whenever the rules file changes.
+// A watcher thread waits on ReadDirectoryChangesW for the file's folder and,
+// once an edit settles, compiles a fresh matcher and publishes it with one
+// atomic pointer store. The sampling thread picks the new set up between
+// samples with a single acquire load: it never waits for a reload and the
+// matcher it is using is never modified underneath it.
+//
+// Old sets are reclaimed RCU-style. Each set carries a generation; the
+// sampling thread reports the generation it has switched to, and at that
+// point nothing older can still be in use, so the watcher frees it.
+class CategoryRules {
+public:
+    struct Set {
+        CategoryMatcher matcher;
+        uint64_t generation = 0;
+    };
+
+private:
+    static constexpr DWORD SettleMs = 500;
+    static constexpr int OpenAttempts = 10;
+
+    std::string rulesPath;
+    std::string folder;
+    std::wstring fileName;
+
+    std::atomic<const Set*> current;
+    std::atomic<uint64_t> readerGeneration;
+
+    // Watcher thread only (and start/stop while it is not running)
+    std::vector<std::unique_ptr<Set>> sets;
+    uint64_t nextGeneration;
+
+    std::thread watcher;
+    HANDLE stopEvent;
+
+    void publish() {
+        std::unique_ptr<Set> set(new Set());
+        set->matcher.compile(loadCategoryRules(rulesPath));
+        set->generation = ++nextGeneration;
+        current.store(set.get(), std::memory_order_release);
+        sets.push_back(std::move(set));
+        reclaim();
+    }
+
+    void reclaim() {
+        uint64_t inUse = readerGeneration.load(std::memory_order_acquire);
+        for (size_t i = 0; i + 1 < sets.size();) {
+            if (sets[i]->generation < inUse) {
+                sets.erase(sets.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    // Waits out the stop event; false if it was signalled
+    bool pause(DWORD ms) const {
+        return WaitForSingleObject(stopEvent, ms) == WAIT_TIMEOUT;
+    }
+
+    // Editors save in several steps and may hold the file open for a moment.
+    // A file that exists but cannot be read yet is retried rather than
+    // replaced by the built-in defaults.
+    bool waitUntilReadable() const {
+        for (int attempt = 0; attempt < OpenAttempts; attempt++) {
+            HANDLE file = CreateFileA(rulesPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file != INVALID_HANDLE_VALUE) {
+                CloseHandle(file);
+                return true;
+            }
+            DWORD error = GetLastError();
+            if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) return true;
+            if (!pause(SettleMs)) return false;
+        }
+        return false;
+    }
+
+    bool mentionsRulesFile(const BYTE* buffer, DWORD bytes) const {
+        // A zero-length result means the change buffer overflowed
+        if (bytes == 0) return true;
+        for (DWORD offset = 0;;) {
+            const FILE_NOTIFY_INFORMATION* entry = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer + offset);
+            size_t length = entry->FileNameLength / sizeof(WCHAR);
+            if (length == fileName.size() &&
+                CompareStringOrdinal(entry->FileName, static_cast<int>(length),
+                                     fileName.c_str(), static_cast<int>(length), TRUE) == CSTR_EQUAL) {
+                return true;
+            }
+            if (entry->NextEntryOffset == 0) return false;
+            offset += entry->NextEntryOffset;
+        }
+    }
+
+    void watchLoop() {
+        HANDLE directory = CreateFileA(folder.c_str(), FILE_LIST_DIRECTORY,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                                       FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        if (directory == INVALID_HANDLE_VALUE) return;
+
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        alignas(DWORD) BYTE buffer[8192];
+
+        for (;;) {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(directory, buffer, sizeof(buffer), FALSE,
+                                       FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+                                       FILE_NOTIFY_CHANGE_SIZE,
+                                       NULL, &overlapped, NULL)) {
+                break;
+            }
+
+            HANDLE waits[2] = { stopEvent, overlapped.hEvent };
+            DWORD bytes = 0;
+            if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+                CancelIoEx(directory, &overlapped);
+                GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+                break;
+            }
+            if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE)) break;
+
+            // The directory handle keeps collecting changes while we settle,
+            // so nothing written meanwhile is missed
+            if (mentionsRulesFile(buffer, bytes)) {
+                if (!pause(SettleMs)) break;
+                if (waitUntilReadable()) {
+                    publish();
+                }
+            } else {
+                reclaim();
+            }
+        }
+
+        CloseHandle(overlapped.hEvent);
+        CloseHandle(directory);
+    }
+
+public:
+    CategoryRules() : current(nullptr), readerGeneration(0), nextGeneration(0), stopEvent(nullptr) {}
+
+    ~CategoryRules() {
+        stop();
+    }
+
+    CategoryRules(const CategoryRules&) = delete;
+    CategoryRules& operator=(const CategoryRules&) = delete;
+
+    // Compiles the rules once, synchronously, then watches path for edits
+    void start(const std::string& path) {
+        if (watcher.joinable()) return;
+
+        rulesPath = path;
+        size_t slash = path.find_last_of("\\/");
+        folder = (slash != std::string::npos) ? path.substr(0, slash + 1) : ".\\";
+        // Notifications name the file in UTF-16; the path here is ANSI
+        std::string name = path.substr(slash != std::string::npos ? slash + 1 : 0);
+        fileName.assign(name.size(), L'\0');
+        int length = MultiByteToWideChar(CP_ACP, 0, name.data(), static_cast<int>(name.size()),
+                                         &fileName[0], static_cast<int>(fileName.size()));
+        fileName.resize(length > 0 ? length : 0);
+        publish();
+
+        stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        watcher = std::thread(&CategoryRules::watchLoop, this);
+    }
+
+    void stop() {
+        if (!watcher.joinable()) return;
+        SetEvent(stopEvent);
+        watcher.join();
+        CloseHandle(stopEvent);
+        stopEvent = nullptr;
+    }
+
+    // Sampling thread. The newest published set; never null after start().
+    const Set* latest() const {
+        return current.load(std::memory_order_acquire);
+    }
+
+    // Sampling thread. Called once set is the only one it still uses.
+    void adopted(const Set* set) {
+        readerGeneration.store(set->generation, std::memory_order_release);
+    }
+};
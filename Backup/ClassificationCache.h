@@ -0,0 +1,94 @@
+// ClassificationCache.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Interned details and category derived from one (process, title, site)
+// triple; site is empty except for browsers with BrowserSites on
+struct Classification {
+    uint32_t details;
+    uint32_t category;
+};
+
+// Direct-mapped memo of classifications keyed on a 64-bit hash of the
+// interned process name, the window title and the browser site. The foreground window rarely
+// changes between samples, so almost every lookup is a hash plus one string
+// compare. Entries keep their key so a hash collision is a miss, never a
+// wrong answer.
+class ClassificationCache {
+public:
+    static constexpr size_t Slots = 64;
+
+private:
+    struct Entry {
+        bool valid = false;
+        uint64_t hash = 0;
+        uint32_t process = 0;
+        std::wstring title;
+        std::wstring site;
+        Classification value = {};
+    };
+
+    Entry entries[Slots];
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    // One round per UTF-16 code unit
+    static uint64_t fnv1a(uint64_t hash, std::wstring_view text) {
+        for (wchar_t unit : text) {
+            hash ^= static_cast<uint16_t>(unit);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+public:
+    ClassificationCache() : hits(0), misses(0) {}
+
+    static uint64_t hashKey(uint32_t process, std::wstring_view title, std::wstring_view site = std::wstring_view()) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash ^= (process >> shift) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+        hash = fnv1a(hash, title);
+        if (site.empty()) return hash;
+        return fnv1a(fnv1a(hash, std::wstring_view(L"\0", 1)), site);
+    }
+
+    // The returned entry stays valid until the next insert()
+    const Classification* find(uint64_t hash, uint32_t process, std::wstring_view title,
+                               std::wstring_view site = std::wstring_view()) {
+        const Entry& entry = entries[hash & (Slots - 1)];
+        if (entry.valid && entry.hash == hash && entry.process == process && entry.title == title &&
+            entry.site == site) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return &entry.value;
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    const Classification& insert(uint64_t hash, uint32_t process, std::wstring_view title,
+                                 std::wstring_view site, const Classification& value) {
+        Entry& entry = entries[hash & (Slots - 1)];
+        entry.valid = true;
+        entry.hash = hash;
+        entry.process = process;
+        entry.title.assign(title.data(), title.size());
+        entry.site.assign(site.data(), site.size());
+        entry.value = value;
+        return entry.value;
+    }
+
+    void clear() {
+        for (auto& entry : entries) {
+            entry.valid = false;
+        }
+    }
+
+    uint64_t getHits() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t getMisses() const { return misses.load(std::memory_order_relaxed); }
+};
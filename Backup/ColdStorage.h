@@ -0,0 +1,530 @@
+// ColdStorage.h
+#pragma once
+#include <windows.h>
+#include <compressapi.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CsvFormat.h"
+#include "CsvReader.h"
+#include "SegmentLog.h"
+
+#pragma comment(lib, "cabinet.lib")
+
+// Compressed, columnar form of a closed CSV partition:
+//
+//   PC_ActivityLog_2024-04.csv  ->  PC_ActivityLog_2024-04.cold
+//
+// The file is a ColdLogHeader followed by one LZMS buffer (Compression
+// API) holding the string dictionary and then the seven columns in CSV
+// order, each a run of varints:
+//
+//   StartTime        zigzag delta from the previous row's start
+//   EndTime          zigzag of end - (start + duration), almost always 0
+//   DurationSeconds  zigzag, as is
+//   text columns     dictionary ID; the dictionary is shared by all four
+//
+// Times are the local seconds the CSV spells out, so a partition decodes
+// back to the same rows whatever the time zone. The header keeps every
+// column's min/max (the text columns' in dictionary IDs), so --query and a
+// --report with a range skip a file that cannot overlap it without
+// decompressing it (ColdLogReader::readHeader and mayOverlap).
+//
+// compactPartition() converts a partition nothing writes to any more,
+// verifies the result against the CSV and only then deletes the CSV. The
+// log writer runs it over the closed partitions (see LogWriter.h). A row
+// that lands in a compacted month later (a recovered journal segment)
+// starts a new CSV, which is merged into the same cold file next time.
+enum class ColdColumn : uint32_t { Start, End, Duration, Window, Details, Process, Category, Count };
+
+struct ColdColumnInfo {
+    uint64_t bytes;         // encoded size inside the decompressed buffer
+    int64_t min;
+    int64_t max;
+};
+
+struct ColdLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t strings;
+    uint32_t algorithm;
+    uint64_t rawBytes;      // decompressed: dictionary, then the columns
+    uint64_t storedBytes;   // compressed, following the header
+    ColdColumnInfo columns[static_cast<size_t>(ColdColumn::Count)];
+};
+
+static_assert(sizeof(ColdLogHeader) == 208, "ColdLogHeader layout");
+
+static const char ColdFileMagic[8] = { 'A', 'L', 'C', 'O', 'L', 'D', 'L', 'G' };
+static const uint32_t ColdLogVersion = 1;
+static const char ColdLogExtension[] = ".cold";
+
+// One row; the text views stay valid until the reader or builder changes
+struct ColdRow {
+    int64_t start;          // local seconds since 1970-01-01 00:00
+    int64_t end;
+    int64_t duration;
+    std::string_view window;
+    std::string_view details;
+    std::string_view process;
+    std::string_view category;
+};
+
+namespace cold_storage_detail {
+
+inline void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+inline bool getVarint(const char*& at, const char* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; at < end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*at++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// "YYYY-MM-DD HH:MM:SS" of local seconds
+inline void appendLocalTimestamp(std::string& out, int64_t seconds) {
+    int64_t day = (seconds >= 0 ? seconds : seconds - 86399) / 86400;
+    int64_t time = seconds - day * 86400;
+    char date[11];
+    csv_format_detail::formatDay(day, date);
+    char text[20];
+    memcpy(text, date, 10);
+    text[10] = ' ';
+    csv_format_detail::putTwoDigits(text + 11, static_cast<int>(time / 3600));
+    text[13] = ':';
+    csv_format_detail::putTwoDigits(text + 14, static_cast<int>(time / 60 % 60));
+    text[16] = ':';
+    csv_format_detail::putTwoDigits(text + 17, static_cast<int>(time % 60));
+    out.append(text, 19);
+}
+
+// A data row of the CSV log; false for anything else
+inline bool parseCsvRow(const CsvReader::Row& row, std::string (&scratch)[4], ColdRow& out) {
+    using namespace csv_format_detail;
+    if (row.count != 7 || row.escaped[0] || row.escaped[1] || row.escaped[2] ||
+        !parseTimestamp(row.fields[0], out.start) || !parseTimestamp(row.fields[1], out.end) ||
+        !parseInteger(row.fields[2], out.duration)) {
+        return false;
+    }
+    out.window = row.text(3, scratch[0]);
+    out.details = row.text(4, scratch[1]);
+    out.process = row.text(5, scratch[2]);
+    out.category = row.text(6, scratch[3]);
+    return true;
+}
+
+inline bool sameRow(const ColdRow& a, const ColdRow& b) {
+    return a.start == b.start && a.end == b.end && a.duration == b.duration && a.window == b.window &&
+           a.details == b.details && a.process == b.process && a.category == b.category;
+}
+
+}
+
+// "<dir>\\PC_ActivityLog_2024-04.csv" -> "<dir>\\PC_ActivityLog_2024-04.cold"
+inline std::string coldPathFor(const std::string& csvPath) {
+    size_t dot = csvPath.find_last_of('.');
+    size_t slash = csvPath.find_last_of("\\/");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return csvPath + ColdLogExtension;
+    return csvPath.substr(0, dot) + ColdLogExtension;
+}
+
+inline bool isColdLogPath(const std::string& path) {
+    size_t length = sizeof(ColdLogExtension) - 1;
+    return path.size() > length && _stricmp(path.c_str() + path.size() - length, ColdLogExtension) == 0;
+}
+
+// Collects rows in memory and writes them as one cold file
+class ColdLogBuilder {
+private:
+    static constexpr size_t Columns = static_cast<size_t>(ColdColumn::Count);
+
+    std::string dictionary;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::string key;
+    std::string columns[Columns];
+    ColdColumnInfo info[Columns];
+    uint32_t rows;
+    int64_t previousStart;
+
+    uint32_t intern(std::string_view text) {
+        key.assign(text.data(), text.size());
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(ids.size());
+        ids.emplace(key, id);
+        uint32_t length = static_cast<uint32_t>(text.size());
+        dictionary.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        dictionary.append(text.data(), text.size());
+        return id;
+    }
+
+    void put(ColdColumn column, uint64_t encoded, int64_t value) {
+        size_t index = static_cast<size_t>(column);
+        cold_storage_detail::putVarint(columns[index], encoded);
+        if (rows == 0 || value < info[index].min) info[index].min = value;
+        if (rows == 0 || value > info[index].max) info[index].max = value;
+    }
+
+    void putText(ColdColumn column, std::string_view text) {
+        uint32_t id = intern(text);
+        put(column, id, id);
+    }
+
+public:
+    ColdLogBuilder() : info(), rows(0), previousStart(0) {}
+
+    ColdLogBuilder(const ColdLogBuilder&) = delete;
+    ColdLogBuilder& operator=(const ColdLogBuilder&) = delete;
+
+    uint32_t rowCount() const { return rows; }
+
+    void add(const ColdRow& row) {
+        using namespace cold_storage_detail;
+        put(ColdColumn::Start, zigzag(row.start - previousStart), row.start);
+        put(ColdColumn::End, zigzag(row.end - (row.start + row.duration)), row.end);
+        put(ColdColumn::Duration, zigzag(row.duration), row.duration);
+        putText(ColdColumn::Window, row.window);
+        putText(ColdColumn::Details, row.details);
+        putText(ColdColumn::Process, row.process);
+        putText(ColdColumn::Category, row.category);
+        previousStart = row.start;
+        rows++;
+    }
+
+    // Writes through a temporary file, so a reader never sees half a file
+    bool write(const std::string& path) {
+        using namespace segment_log_detail;
+        ColdLogHeader header = {};
+        memcpy(header.magic, ColdFileMagic, sizeof(header.magic));
+        header.version = ColdLogVersion;
+        header.rows = rows;
+        header.strings = static_cast<uint32_t>(ids.size());
+        header.algorithm = COMPRESS_ALGORITHM_LZMS;
+
+        std::string raw = dictionary;
+        for (size_t i = 0; i < Columns; i++) {
+            raw += columns[i];
+            header.columns[i] = info[i];
+            header.columns[i].bytes = columns[i].size();
+        }
+        header.rawBytes = raw.size();
+
+        COMPRESSOR_HANDLE compressor = nullptr;
+        if (!CreateCompressor(COMPRESS_ALGORITHM_LZMS, NULL, &compressor)) return false;
+        SIZE_T needed = 0;
+        Compress(compressor, raw.data(), raw.size(), NULL, 0, &needed);
+        std::vector<char> stored(needed);
+        SIZE_T storedSize = 0;
+        bool compressed = needed > 0 && Compress(compressor, raw.data(), raw.size(), stored.data(), needed, &storedSize);
+        CloseCompressor(compressor);
+        if (!compressed) return false;
+        header.storedBytes = storedSize;
+
+        std::string temp = path + ".tmp";
+        HANDLE file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        bool ok = writeAll(file, &header, sizeof(header)) && writeAll(file, stored.data(), storedSize) &&
+                  FlushFileBuffers(file);
+        CloseHandle(file);
+        if (!ok || !MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileA(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// Decodes a cold file row by row. The whole file is decompressed on open;
+// partitions are a month or PartitionSizeMB of CSV, a few MB at most.
+class ColdLogReader {
+private:
+    static constexpr size_t Columns = static_cast<size_t>(ColdColumn::Count);
+
+    ColdLogHeader header;
+    std::vector<char> raw;
+    std::vector<std::string_view> strings;
+    const char* at[Columns];
+    const char* end[Columns];
+    uint32_t remaining;
+    int64_t previousStart;
+
+    bool text(ColdColumn column, std::string_view& value) {
+        size_t index = static_cast<size_t>(column);
+        uint64_t id;
+        if (!cold_storage_detail::getVarint(at[index], end[index], id) || id >= strings.size()) return false;
+        value = strings[static_cast<size_t>(id)];
+        return true;
+    }
+
+    bool number(ColdColumn column, int64_t& value) {
+        size_t index = static_cast<size_t>(column);
+        uint64_t encoded;
+        if (!cold_storage_detail::getVarint(at[index], end[index], encoded)) return false;
+        value = cold_storage_detail::unzigzag(encoded);
+        return true;
+    }
+
+    bool decode(const std::vector<char>& stored) {
+        raw.resize(static_cast<size_t>(header.rawBytes));
+        DECOMPRESSOR_HANDLE decompressor = nullptr;
+        if (!CreateDecompressor(header.algorithm, NULL, &decompressor)) return false;
+        SIZE_T size = 0;
+        bool ok = Decompress(decompressor, stored.data(), stored.size(), raw.data(), raw.size(), &size) &&
+                  size == raw.size();
+        CloseDecompressor(decompressor);
+        if (!ok) return false;
+
+        uint64_t columnBytes = 0;
+        for (const auto& column : header.columns) {
+            columnBytes += column.bytes;
+        }
+        if (columnBytes > raw.size()) return false;
+        const char* pos = raw.data();
+        const char* dictionaryEnd = raw.data() + (raw.size() - columnBytes);
+        strings.reserve(header.strings);
+        while (strings.size() < header.strings) {
+            uint32_t length;
+            if (static_cast<size_t>(dictionaryEnd - pos) < sizeof(length)) return false;
+            memcpy(&length, pos, sizeof(length));
+            pos += sizeof(length);
+            if (static_cast<size_t>(dictionaryEnd - pos) < length) return false;
+            strings.emplace_back(pos, length);
+            pos += length;
+        }
+        for (size_t i = 0; i < Columns; i++) {
+            at[i] = pos;
+            pos += header.columns[i].bytes;
+            end[i] = pos;
+        }
+        return true;
+    }
+
+public:
+    ColdLogReader() : header(), remaining(0), previousStart(0) {}
+
+    ColdLogReader(const ColdLogReader&) = delete;
+    ColdLogReader& operator=(const ColdLogReader&) = delete;
+
+    static HANDLE openFile(const std::string& path) {
+        return CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    }
+
+    static bool readHeader(HANDLE file, ColdLogHeader& header) {
+        using namespace segment_log_detail;
+        int64_t size = fileSize(file);
+        return size >= static_cast<int64_t>(sizeof(header)) && readAll(file, &header, sizeof(header)) &&
+               memcmp(header.magic, ColdFileMagic, sizeof(header.magic)) == 0 &&
+               header.version == ColdLogVersion &&
+               header.storedBytes == static_cast<uint64_t>(size) - sizeof(header);
+    }
+
+    // Reads just the header of path, without decompressing anything; false
+    // if it is not a cold file
+    static bool readHeader(const std::string& path, ColdLogHeader& header) {
+        HANDLE file = openFile(path);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        bool ok = readHeader(file, header);
+        CloseHandle(file);
+        return ok;
+    }
+
+    // Whether a file with this header can hold a row overlapping [start,
+    // end), in local seconds. A row is taken to end at the later of EndTime
+    // and start + duration, which differ across a DST change.
+    static bool mayOverlap(const ColdLogHeader& header, int64_t start, int64_t end) {
+        const ColdColumnInfo& starts = header.columns[static_cast<size_t>(ColdColumn::Start)];
+        const ColdColumnInfo& ends = header.columns[static_cast<size_t>(ColdColumn::End)];
+        const ColdColumnInfo& durations = header.columns[static_cast<size_t>(ColdColumn::Duration)];
+        if (header.rows == 0 || starts.min >= end) return false;
+        return std::max(ends.max, starts.max + durations.max) > start;
+    }
+
+    // Reads and decompresses path; false if it is not a readable cold file
+    bool open(const std::string& path) {
+        using namespace segment_log_detail;
+        raw.clear();
+        strings.clear();
+        remaining = 0;
+        previousStart = 0;
+
+        HANDLE file = openFile(path);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        std::vector<char> stored;
+        bool ok = readHeader(file, header);
+        if (ok) {
+            stored.resize(static_cast<size_t>(header.storedBytes));
+            ok = stored.empty() || readAll(file, stored.data(), stored.size());
+        }
+        CloseHandle(file);
+        if (!ok || !decode(stored)) return false;
+        remaining = header.rows;
+        return true;
+    }
+
+    uint32_t rows() const { return header.rows; }
+
+    // False at the end, or at the first row that does not decode
+    bool next(ColdRow& row) {
+        if (remaining == 0) return false;
+        int64_t delta, endOffset;
+        if (!number(ColdColumn::Start, delta) || !number(ColdColumn::End, endOffset) ||
+            !number(ColdColumn::Duration, row.duration) || !text(ColdColumn::Window, row.window) ||
+            !text(ColdColumn::Details, row.details) || !text(ColdColumn::Process, row.process) ||
+            !text(ColdColumn::Category, row.category)) {
+            remaining = 0;
+            return false;
+        }
+        row.start = previousStart + delta;
+        row.end = row.start + row.duration + endOffset;
+        previousStart = row.start;
+        remaining--;
+        return true;
+    }
+
+    // The row as the CSV log had it
+    static void appendCsv(std::string& out, const ColdRow& row) {
+        cold_storage_detail::appendLocalTimestamp(out, row.start);
+        out += ',';
+        cold_storage_detail::appendLocalTimestamp(out, row.end);
+        out += ',';
+        out += std::to_string(row.duration);
+        out += ',';
+        appendCsvQuoted(out, row.window);
+        out += ',';
+        appendCsvQuoted(out, row.details);
+        out += ',';
+        appendCsvQuoted(out, row.process);
+        out += ',';
+        appendCsvQuoted(out, row.category);
+        out += '\n';
+    }
+};
+
+// The whole cold file as CSV text, header included. Returns the rows
+// decoded, or -1.
+inline long long decodeColdLogToCsv(const std::string& path, std::string& csv) {
+    ColdLogReader reader;
+    if (!reader.open(path)) return -1;
+    csv.assign(CsvHeader, sizeof(CsvHeader) - 1);
+    ColdRow row;
+    uint32_t decoded = 0;
+    while (reader.next(row)) {
+        ColdLogReader::appendCsv(csv, row);
+        decoded++;
+    }
+    return decoded == reader.rows() ? decoded : -1;
+}
+
+// Converts one CSV partition (merged with its cold file, if there is one)
+// and deletes the CSV. Nothing changes unless every row parses and the
+// written file decodes back to the same rows. The CSV is held without
+// write sharing throughout, so it is skipped while the log writer has it open
+// and the writer cannot append to it behind our back.
+inline bool compactPartition(const std::string& csvPath) {
+    using namespace cold_storage_detail;
+    HANDLE file = CreateFileA(csvPath.c_str(), GENERIC_READ | DELETE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    int64_t size = segment_log_detail::fileSize(file);
+    HANDLE mapping = size > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : nullptr;
+    const char* data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    auto release = [&](bool remove) {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (remove) {
+            FILE_DISPOSITION_INFO disposition = { TRUE };
+            remove = SetFileInformationByHandle(file, FileDispositionInfo, &disposition, sizeof(disposition)) != 0;
+        }
+        CloseHandle(file);
+        return remove;
+    };
+    if (!data) return release(false);
+
+    std::string coldPath = coldPathFor(csvPath);
+    ColdLogBuilder builder;
+    ColdRow row;
+    {
+        ColdLogReader existing;
+        if (existing.open(coldPath)) {
+            uint32_t kept = 0;
+            while (existing.next(row)) {
+                builder.add(row);
+                kept++;
+            }
+            if (kept != existing.rows()) return release(false);
+        } else if (GetFileAttributesA(coldPath.c_str()) != INVALID_FILE_ATTRIBUTES) {
+            return release(false);     // there but unreadable: leave both alone
+        }
+    }
+    uint32_t previousRows = builder.rowCount();
+
+    CsvReader reader;
+    CsvReader::Row fields;
+    std::string scratch[4];
+    auto eachRow = [&](auto&& onRow) {
+        reader.attach(data, static_cast<size_t>(size));
+        bool first = true;
+        while (reader.next(fields)) {
+            if (first) {
+                first = false;
+                if (fields.count > 0 && fields.fields[0] == "StartTime") continue;
+            }
+            if (fields.count == 1 && fields.fields[0].empty()) continue; // blank line
+            if (!parseCsvRow(fields, scratch, row) || !onRow(row)) return false;
+        }
+        return true;
+    };
+
+    if (!eachRow([&](const ColdRow& parsed) { builder.add(parsed); return true; }) ||
+        builder.rowCount() == previousRows || !builder.write(coldPath)) {
+        return release(false);
+    }
+
+    // Read back what was written before giving up the CSV
+    ColdLogReader written;
+    bool same = written.open(coldPath) && written.rows() == builder.rowCount();
+    ColdRow stored;
+    for (uint32_t i = 0; same && i < previousRows; i++) {
+        same = written.next(stored);
+    }
+    same = same && eachRow([&](const ColdRow& parsed) { return written.next(stored) && sameRow(stored, parsed); });
+    return release(same);
+}
+
+// --export-csv for a cold file; returns the rows written or -1
+inline long long exportColdLogToCsv(const std::string& coldPath, const std::string& csvPath) {
+    std::string csv;
+    long long rows = decodeColdLogToCsv(coldPath, csv);
+    if (rows < 0) return -1;
+    HANDLE out = CreateFileA(csvPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out == INVALID_HANDLE_VALUE) return -1;
+    bool ok = segment_log_detail::writeAll(out, csv.data(), csv.size());
+    CloseHandle(out);
+    return ok ? rows : -1;
+}
@@ -0,0 +1,256 @@
+// CsvFormat.h
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Column layout of the activity log, shared by every writer and exporter
+static const char CsvHeader[] = "StartTime,EndTime,DurationSeconds,WindowTitle,WindowDetails,ProcessName,Category\n";
+
+namespace csv_format_detail {
+
+// "00" through "99", two characters per entry
+struct DigitPairs {
+    char text[200];
+    constexpr DigitPairs() : text() {
+        for (int i = 0; i < 100; i++) {
+            text[2 * i] = static_cast<char>('0' + i / 10);
+            text[2 * i + 1] = static_cast<char>('0' + i % 10);
+        }
+    }
+};
+static constexpr DigitPairs Digits;
+
+inline void putTwoDigits(char* out, int value) {
+    memcpy(out, Digits.text + 2 * value, 2);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+inline int64_t daysFromCivil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+// "YYYY-MM-DD" of a day number
+inline void formatDay(int64_t days, char (&text)[11]) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned monthIndex = (5 * dayOfYear + 2) / 153;
+    unsigned day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    unsigned month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    int year = static_cast<int>(yearOfEra + era * 400) + (month <= 2);
+    snprintf(text, sizeof(text), "%04d-%02u-%02u", year, month, day);
+}
+
+inline bool parseDigits(std::string_view text, size_t at, size_t count, unsigned& value) {
+    value = 0;
+    for (size_t i = at; i < at + count; i++) {
+        unsigned digit = static_cast<unsigned>(text[i] - '0');
+        if (digit > 9) return false;
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+// "YYYY-MM-DD HH:MM:SS" as local seconds since 1970-01-01 00:00
+inline bool parseTimestamp(std::string_view text, int64_t& seconds) {
+    unsigned year, month, day, hour, minute, second;
+    if (text.size() < 19 || text[4] != '-' || text[7] != '-' || text[13] != ':' || text[16] != ':' ||
+        !parseDigits(text, 0, 4, year) || !parseDigits(text, 5, 2, month) || !parseDigits(text, 8, 2, day) ||
+        !parseDigits(text, 11, 2, hour) || !parseDigits(text, 14, 2, minute) || !parseDigits(text, 17, 2, second) ||
+        month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+    seconds = daysFromCivil(static_cast<int>(year), month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+inline bool parseInteger(std::string_view text, int64_t& value) {
+    if (text.empty()) return false;
+    bool negative = text[0] == '-';
+    size_t i = negative ? 1 : 0;
+    if (i == text.size()) return false;
+    value = 0;
+    for (; i < text.size(); i++) {
+        unsigned digit = static_cast<unsigned>(text[i] - '0');
+        if (digit > 9) return false;
+        value = value * 10 + digit;
+    }
+    if (negative) value = -value;
+    return true;
+}
+
+}
+
+// Appends field in double quotes, doubling embedded quotes. Runs between
+// quotes are copied in bulk.
+inline void appendCsvQuoted(std::string& out, std::string_view field) {
+    out += '"';
+    size_t from = 0;
+    for (size_t quote; (quote = field.find('"', from)) != std::string_view::npos; from = quote + 1) {
+        out.append(field.data() + from, quote + 1 - from);
+        out += '"';
+    }
+    out.append(field.data() + from, field.size() - from);
+    out += '"';
+}
+
+// Splits one CSV line into fields, honouring double-quoted fields
+inline std::vector<std::string> splitCsvLine(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char ch = line[i];
+        if (quoted) {
+            if (ch == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                i++;
+            } else if (ch == '"') {
+                quoted = false;
+            } else {
+                fields.back() += ch;
+            }
+        } else if (ch == '"') {
+            quoted = true;
+        } else if (ch == ',') {
+            fields.emplace_back();
+        } else if (ch != '\r' && ch != '\n') {
+            fields.back() += ch;
+        }
+    }
+    return fields;
+}
+
+inline std::string trimCopy(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    size_t last = text.find_last_not_of(" \t");
+    return text.substr(first, last - first + 1);
+}
+
+// Appends log rows to a caller-owned buffer. Timestamps come from a cached
+// "YYYY-MM-DD " prefix for the current local day plus the time of day worked
+// out arithmetically, so localtime_s runs about once a day instead of twice
+// per row. Text fields are always quoted, with embedded quotes doubled.
+class CsvRowFormatter {
+private:
+    // Every time in [validFrom, validUntil) has the local date in datePrefix
+    // and is dayStart plus its local time of day
+    time_t dayStart = 0;
+    time_t validFrom = 0;
+    time_t validUntil = 0;
+    char datePrefix[11];
+
+    static bool localTime(time_t time, struct tm& local) {
+        return localtime_s(&local, &time) == 0;
+    }
+
+    void writeDate(const struct tm& local) {
+        using namespace csv_format_detail;
+        int year = local.tm_year + 1900;
+        putTwoDigits(datePrefix, (year / 100) % 100);
+        putTwoDigits(datePrefix + 2, year % 100);
+        datePrefix[4] = '-';
+        putTwoDigits(datePrefix + 5, local.tm_mon + 1);
+        datePrefix[7] = '-';
+        putTwoDigits(datePrefix + 8, local.tm_mday);
+        datePrefix[10] = ' ';
+    }
+
+    void enterSpan(time_t time) {
+        struct tm local;
+        if (!localTime(time, local)) {
+            memcpy(datePrefix, "0000-00-00 ", sizeof(datePrefix));
+            dayStart = validFrom = time;
+            validUntil = time + 1;
+            return;
+        }
+        writeDate(local);
+
+        dayStart = time - (local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec);
+        validFrom = dayStart;
+        validUntil = dayStart + 24 * 3600;
+
+        // On a DST change day the offset moves part-way through, so the whole
+        // day cannot share one span; fall back to the current minute
+        struct tm first, last;
+        if (!localTime(validFrom, first) || first.tm_hour != 0 || first.tm_min != 0 || first.tm_sec != 0 ||
+            !localTime(validUntil - 1, last) || last.tm_mday != local.tm_mday ||
+            last.tm_hour != 23 || last.tm_min != 59 || last.tm_sec != 59) {
+            validFrom = time - local.tm_sec;
+            validUntil = validFrom + 60;
+        }
+    }
+
+    void appendTimestamp(std::string& out, time_t time) {
+        using namespace csv_format_detail;
+        if (time < validFrom || time >= validUntil) {
+            enterSpan(time);
+        }
+        long seconds = static_cast<long>(time - dayStart);
+
+        char text[19];
+        memcpy(text, datePrefix, sizeof(datePrefix));
+        putTwoDigits(text + 11, static_cast<int>(seconds / 3600));
+        text[13] = ':';
+        putTwoDigits(text + 14, static_cast<int>(seconds / 60 % 60));
+        text[16] = ':';
+        putTwoDigits(text + 17, static_cast<int>(seconds % 60));
+        out.append(text, sizeof(text));
+    }
+
+    static void appendInteger(std::string& out, long long value) {
+        using namespace csv_format_detail;
+        char text[24];
+        char* end = text + sizeof(text);
+        char* pos = end;
+        unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                                                 : static_cast<unsigned long long>(value);
+        while (magnitude >= 100) {
+            pos -= 2;
+            putTwoDigits(pos, static_cast<int>(magnitude % 100));
+            magnitude /= 100;
+        }
+        if (magnitude >= 10) {
+            pos -= 2;
+            putTwoDigits(pos, static_cast<int>(magnitude));
+        } else {
+            *--pos = static_cast<char>('0' + magnitude);
+        }
+        if (value < 0) {
+            *--pos = '-';
+        }
+        out.append(pos, end - pos);
+    }
+
+public:
+    void appendRow(std::string& out, time_t start, time_t end, long long durationSeconds,
+                   std::string_view window, std::string_view details,
+                   std::string_view process, std::string_view category) {
+        appendTimestamp(out, start);
+        out += ',';
+        appendTimestamp(out, end);
+        out += ',';
+        appendInteger(out, durationSeconds);
+        out += ',';
+        appendCsvQuoted(out, window);
+        out += ',';
+        appendCsvQuoted(out, details);
+        out += ',';
+        appendCsvQuoted(out, process);
+        out += ',';
+        appendCsvQuoted(out, category);
+        out += '\n';
+    }
+};
@@ -0,0 +1,284 @@
+// CsvReader.h
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CSV_READER_SSE2 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Zero-copy reader for logs in the CsvRowFormatter layout (and any CSV that
+// follows the same quoting rules as splitCsvLine). The file is memory-mapped
+// and the next quote, comma, CR or newline is found 16 bytes at a time with
+// SSE2 (32 with AVX2 when the build targets it), so the long quoted titles
+// that make up most of a log are skipped without looking at each byte.
+//
+// Fields come back as string_views into the mapping. A field written as
+// "text" with no embedded quotes is returned without its quotes; anything
+// else that still carries CSV quoting (doubled quotes, quotes mid-field) is
+// returned raw and flagged, and only those go through unescape().
+namespace csv_reader_detail {
+
+inline unsigned lowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline bool isStructural(char ch) {
+    return ch == '"' || ch == ',' || ch == '\r' || ch == '\n';
+}
+
+// First quote, comma, CR or LF in [from, size), or size
+inline size_t findStructural(const char* data, size_t from, size_t size) {
+    size_t pos = from;
+#if defined(__AVX2__)
+    const __m256i quotes32 = _mm256_set1_epi8('"');
+    const __m256i commas32 = _mm256_set1_epi8(',');
+    const __m256i returns32 = _mm256_set1_epi8('\r');
+    const __m256i newlines32 = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, quotes32), _mm256_cmpeq_epi8(block, commas32)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, returns32), _mm256_cmpeq_epi8(block, newlines32)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if (mask) return pos + lowestBit(mask);
+    }
+#endif
+#if defined(CSV_READER_SSE2)
+    const __m128i quotes = _mm_set1_epi8('"');
+    const __m128i commas = _mm_set1_epi8(',');
+    const __m128i returns = _mm_set1_epi8('\r');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quotes), _mm_cmpeq_epi8(block, commas)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, returns), _mm_cmpeq_epi8(block, newlines)));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+        if (mask) return pos + lowestBit(mask);
+    }
+#endif
+    for (; pos < size; pos++) {
+        if (isStructural(data[pos])) return pos;
+    }
+    return size;
+}
+
+// First quote in [from, size), or size
+inline size_t findQuote(const char* data, size_t from, size_t size) {
+    size_t pos = from;
+#if defined(__AVX2__)
+    const __m256i quotes32 = _mm256_set1_epi8('"');
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, quotes32)));
+        if (mask) return pos + lowestBit(mask);
+    }
+#endif
+#if defined(CSV_READER_SSE2)
+    const __m128i quotes = _mm_set1_epi8('"');
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, quotes)));
+        if (mask) return pos + lowestBit(mask);
+    }
+#endif
+    for (; pos < size; pos++) {
+        if (data[pos] == '"') return pos;
+    }
+    return size;
+}
+
+}
+
+class CsvReader {
+public:
+    static constexpr size_t MaxFields = 16;
+
+    // Fields past MaxFields are skipped; count stops there
+    struct Row {
+        std::string_view fields[MaxFields];
+        bool escaped[MaxFields];
+        size_t count = 0;
+        size_t offset = 0;      // of the row's first byte
+
+        // The field's text, decoded into scratch when it still has quoting
+        std::string_view text(size_t index, std::string& scratch) const {
+            if (index >= count) return std::string_view();
+            return escaped[index] ? unescape(fields[index], scratch) : fields[index];
+        }
+    };
+
+private:
+    HANDLE file;
+    HANDLE mapping;
+    const char* view;       // owned mapping, if any
+    const char* data;
+    size_t size;
+    size_t pos;
+
+public:
+    CsvReader() : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), data(nullptr), size(0), pos(0) {}
+
+    ~CsvReader() {
+        close();
+    }
+
+    CsvReader(const CsvReader&) = delete;
+    CsvReader& operator=(const CsvReader&) = delete;
+
+    // Maps path for reading; other processes may keep appending to it. An
+    // empty file opens and yields no rows.
+    bool open(const std::string& path) {
+        close();
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            close();
+            return false;
+        }
+        if (fileSize.QuadPart == 0) return true;
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+        if (!view) {
+            close();
+            return false;
+        }
+        attach(view, static_cast<size_t>(fileSize.QuadPart));
+        return true;
+    }
+
+    // Reads from memory the caller keeps alive, starting at offset. A UTF-8
+    // byte order mark at the very start is skipped.
+    void attach(const char* text, size_t length, size_t offset = 0) {
+        data = text;
+        size = length;
+        pos = offset;
+        if (pos == 0 && size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+            pos = 3;
+        }
+    }
+
+    void close() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        view = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        data = nullptr;
+        size = 0;
+        pos = 0;
+    }
+
+    const char* begin() const { return data; }
+    size_t length() const { return size; }
+    size_t offset() const { return pos; }
+
+    // Splits the next row into row.fields. Newlines inside quotes belong to
+    // the field; CRLF and LF both end a row. Returns false at end of input.
+    bool next(Row& row) {
+        using namespace csv_reader_detail;
+        row.count = 0;
+        if (pos >= size) return false;
+        row.offset = pos;
+
+        for (;;) {
+            size_t fieldStart = pos;
+            size_t fieldEnd;
+            unsigned quotes = 0;
+            bool strayReturn = false;
+            bool rowEnds = false;
+
+            for (;;) {
+                // After a closing quote the delimiter is usually the very next byte
+                size_t at = (pos < size && isStructural(data[pos])) ? pos : findStructural(data, pos, size);
+                if (at >= size) {
+                    fieldEnd = pos = size;
+                    rowEnds = true;
+                    break;
+                }
+                char ch = data[at];
+                if (ch == '"') {
+                    // Skip the quoted run; a doubled quote closes and reopens it
+                    size_t close = findQuote(data, at + 1, size);
+                    quotes += (close < size) ? 2 : 1;
+                    pos = (close < size) ? close + 1 : size;
+                    continue;
+                }
+                if (ch == '\r' && at + 1 < size && data[at + 1] != '\n') {
+                    strayReturn = true;
+                    pos = at + 1;
+                    continue;
+                }
+                fieldEnd = at;
+                if (ch == ',') {
+                    pos = at + 1;
+                } else {
+                    pos = (ch == '\r') ? at + 2 : at + 1;
+                    if (pos > size) pos = size;
+                    rowEnds = true;
+                }
+                break;
+            }
+
+            if (row.count < MaxFields) {
+                std::string_view raw(data + fieldStart, fieldEnd - fieldStart);
+                bool plain = !strayReturn && quotes == 0;
+                bool simpleQuoted = !strayReturn && quotes == 2 && raw.size() >= 2 &&
+                                    raw.front() == '"' && raw.back() == '"';
+                row.fields[row.count] = simpleQuoted ? raw.substr(1, raw.size() - 2) : raw;
+                row.escaped[row.count] = !plain && !simpleQuoted;
+                row.count++;
+            }
+            if (rowEnds) return true;
+        }
+    }
+
+    // Undoes CSV quoting on a raw field: a quote toggles quoting, a doubled
+    // quote inside quotes is one quote, and CR outside quotes is dropped
+    static std::string_view unescape(std::string_view raw, std::string& scratch) {
+        scratch.clear();
+        bool quoted = false;
+        for (size_t i = 0; i < raw.size(); i++) {
+            char ch = raw[i];
+            if (quoted) {
+                if (ch == '"' && i + 1 < raw.size() && raw[i + 1] == '"') {
+                    scratch += '"';
+                    i++;
+                } else if (ch == '"') {
+                    quoted = false;
+                } else {
+                    scratch += ch;
+                }
+            } else if (ch == '"') {
+                quoted = true;
+            } else if (ch != '\r') {
+                scratch += ch;
+            }
+        }
+        return scratch;
+    }
+};
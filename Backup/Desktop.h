@@ -0,0 +1,99 @@
+// Desktop.h
+#pragma once
+#include <windows.h>
+#include <cwchar>
+#include <string_view>
+
+// The few Win32 calls the sampling path makes to look at the desktop. The
+// normal build forwards straight to Win32; building with
+// /DACTIVITYLOGGER_REPLAY (nmake bench) answers them from replayState
+// instead, so ReplayBenchmark.h can push recorded or synthetic traces
+// through the real capture, classify and log code at full speed.
+namespace desktop {
+
+#ifdef ACTIVITYLOGGER_REPLAY
+
+// What the replayed desktop shows right now. A window handle stands for one
+// process; the fake process handle is its ID.
+struct ReplayState {
+    HWND window = nullptr;
+    DWORD processId = 0;
+    std::wstring_view title;
+    std::wstring_view imagePath;
+    DWORD tickCount = 0;
+    DWORD lastInputTick = 0;
+};
+
+inline ReplayState replayState;
+
+inline HWND foregroundWindow() { return replayState.window; }
+
+inline int windowText(HWND window, LPWSTR text, int capacity) {
+    if (window != replayState.window || capacity <= 0) return 0;
+    size_t length = replayState.title.size() < static_cast<size_t>(capacity - 1)
+                    ? replayState.title.size() : static_cast<size_t>(capacity - 1);
+    wmemcpy(text, replayState.title.data(), length);
+    text[length] = L'\0';
+    return static_cast<int>(length);
+}
+
+inline int windowTextLength(HWND window) {
+    return window == replayState.window ? static_cast<int>(replayState.title.size()) : 0;
+}
+
+inline DWORD windowThreadProcessId(HWND window, DWORD* processId) {
+    *processId = (window == replayState.window) ? replayState.processId : 0;
+    return *processId;
+}
+
+inline HANDLE openProcess(DWORD processId) {
+    return processId ? reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(processId)) : nullptr;
+}
+
+inline BOOL processTimes(HANDLE process, FILETIME* creation, FILETIME* exitTime, FILETIME* kernel, FILETIME* user) {
+    *creation = *exitTime = *kernel = *user = FILETIME();
+    return process != nullptr;
+}
+
+inline BOOL processImageName(HANDLE process, LPWSTR path, DWORD* size) {
+    if (reinterpret_cast<ULONG_PTR>(process) != replayState.processId || replayState.imagePath.size() >= *size) {
+        return FALSE;
+    }
+    wmemcpy(path, replayState.imagePath.data(), replayState.imagePath.size());
+    *size = static_cast<DWORD>(replayState.imagePath.size());
+    path[*size] = L'\0';
+    return TRUE;
+}
+
+inline void closeProcess(HANDLE) {}
+
+inline BOOL lastInputInfo(LASTINPUTINFO* info) {
+    info->dwTime = replayState.lastInputTick;
+    return TRUE;
+}
+
+inline DWORD tickCount() { return replayState.tickCount; }
+
+#else
+
+inline HWND foregroundWindow() { return GetForegroundWindow(); }
+inline int windowText(HWND window, LPWSTR text, int capacity) { return GetWindowTextW(window, text, capacity); }
+inline int windowTextLength(HWND window) { return GetWindowTextLengthW(window); }
+inline DWORD windowThreadProcessId(HWND window, DWORD* processId) { return GetWindowThreadProcessId(window, processId); }
+inline HANDLE openProcess(DWORD processId) { return OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId); }
+
+inline BOOL processTimes(HANDLE process, FILETIME* creation, FILETIME* exitTime, FILETIME* kernel, FILETIME* user) {
+    return GetProcessTimes(process, creation, exitTime, kernel, user);
+}
+
+inline BOOL processImageName(HANDLE process, LPWSTR path, DWORD* size) {
+    return QueryFullProcessImageNameW(process, 0, path, size);
+}
+
+inline void closeProcess(HANDLE process) { CloseHandle(process); }
+inline BOOL lastInputInfo(LASTINPUTINFO* info) { return GetLastInputInfo(info); }
+inline DWORD tickCount() { return GetTickCount(); }
+
+#endif
+
+}
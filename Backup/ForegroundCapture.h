@@ -0,0 +1,171 @@
+// ForegroundCapture.h
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <cwchar>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "BrowserSites.h"
+#include "Desktop.h"
+#include "StringPool.h"
+
+// Window title captured as UTF-16 into fixed storage so sampling never
+// allocates. Titles longer than the buffer are cut at Capacity - 1 code
+// units, the same way every time, and end in an ellipsis so the log shows
+// the cut.
+struct TitleBuffer {
+    static constexpr int Capacity = 1024;
+    wchar_t text[Capacity];
+    int length = 0;
+    
+    std::wstring_view view() const { return std::wstring_view(text, length); }
+    bool empty() const { return length == 0; }
+    void clear() { length = 0; }
+    
+    void assign(const TitleBuffer& other) {
+        wmemcpy(text, other.text, other.length);
+        length = other.length;
+    }
+};
+
+// Everything known about the foreground window at one instant. Title and
+// process are captured from the same HWND so a row can never pair the title
+// of one window with the executable of another.
+struct ForegroundSnapshot {
+    HWND hwnd = nullptr;
+    DWORD processId = 0;
+    TitleBuffer title;
+    uint32_t process = StringPool::Empty;
+    SiteBuffer site;        // browsers only, with BrowserSites on
+};
+
+// Interned executable names keyed on (PID, process creation time). The
+// creation time guards against PID reuse; the image path is only queried for
+// a process that has not been seen before, and nothing at all is queried
+// while the same window stays in front.
+class ProcessNameCache {
+private:
+    struct Entry {
+        DWORD processId;
+        ULONGLONG creationTime;
+        uint32_t name;
+    };
+    
+    static const size_t MaxEntries = 64;
+    std::vector<Entry> entries;
+    size_t nextVictim = 0;
+    
+    // A live window pins its owning process, so its PID cannot be reused
+    HWND lastHwnd = nullptr;
+    DWORD lastProcessId = 0;
+    uint32_t lastName = StringPool::Empty;
+
+    // Interns the file name part of the image path straight from the stack
+    // buffer
+    static uint32_t internImageName(HANDLE hProcess, StringPool& pool) {
+        wchar_t processName[MAX_PATH];
+        DWORD size = MAX_PATH;
+        if (!desktop::processImageName(hProcess, processName, &size)) return StringPool::Empty;
+        
+        std::wstring_view fullPath(processName, size);
+        size_t pos = fullPath.find_last_of(L"\\/");
+        return pool.intern((pos != std::wstring_view::npos) ? fullPath.substr(pos + 1) : fullPath);
+    }
+
+public:
+    uint32_t lookup(HWND hwnd, DWORD processId, StringPool& pool) {
+        if (hwnd == lastHwnd && processId == lastProcessId) return lastName;
+        
+        lastHwnd = hwnd;
+        lastProcessId = processId;
+        lastName = StringPool::Empty;
+        
+        HANDLE hProcess = desktop::openProcess(processId);
+        if (!hProcess) return lastName;
+        
+        FILETIME creation, exitTime, kernelTime, userTime;
+        ULONGLONG creationTime = 0;
+        if (desktop::processTimes(hProcess, &creation, &exitTime, &kernelTime, &userTime)) {
+            creationTime = (static_cast<ULONGLONG>(creation.dwHighDateTime) << 32) | creation.dwLowDateTime;
+        }
+        
+        for (const auto& entry : entries) {
+            if (entry.processId == processId && entry.creationTime == creationTime) {
+                desktop::closeProcess(hProcess);
+                lastName = entry.name;
+                return lastName;
+            }
+        }
+        
+        lastName = internImageName(hProcess, pool);
+        desktop::closeProcess(hProcess);
+        
+        if (lastName != StringPool::Empty) {
+            Entry entry = { processId, creationTime, lastName };
+            if (entries.size() < MaxEntries) {
+                entries.push_back(entry);
+            } else {
+                entries[nextVictim] = entry;
+                nextVictim = (nextVictim + 1) % MaxEntries;
+            }
+        }
+        return lastName;
+    }
+};
+
+// The pipeline's first stage: what is in front right now. Only the thread
+// that is currently sampling may call capture().
+class ForegroundCapture {
+private:
+    ProcessNameCache processNames;
+    std::unique_ptr<BrowserSiteProvider> sites;
+    
+    // Whether the last process looked up is a browser
+    uint32_t checkedProcess = StringPool::Empty;
+    bool checkedIsBrowser = false;
+
+public:
+    // Reads browser sites through UI Automation from now on
+    void enableBrowserSites() {
+        if (sites) return;
+        sites.reset(new BrowserSiteProvider());
+        sites->start();
+    }
+    
+
+    // One GetForegroundWindow per sample; title and process come from that
+    // HWND. Fills the snapshot in place so its title buffer is reused.
+    void capture(ForegroundSnapshot& snapshot, StringPool& pool) {
+        snapshot.hwnd = desktop::foregroundWindow();
+        snapshot.processId = 0;
+        snapshot.title.clear();
+        snapshot.process = StringPool::Empty;
+        snapshot.site.clear();
+        if (!snapshot.hwnd) return;
+        
+        TitleBuffer& title = snapshot.title;
+        int length = desktop::windowText(snapshot.hwnd, title.text, TitleBuffer::Capacity);
+        title.length = length > 0 ? length : 0;
+        if (title.length == TitleBuffer::Capacity - 1 && desktop::windowTextLength(snapshot.hwnd) > title.length) {
+            // Never leave half a surrogate pair before the mark
+            if (IS_HIGH_SURROGATE(title.text[title.length - 2])) title.length--;
+            title.text[title.length - 1] = L'\x2026';
+        }
+        
+        desktop::windowThreadProcessId(snapshot.hwnd, &snapshot.processId);
+        if (snapshot.processId) {
+            snapshot.process = processNames.lookup(snapshot.hwnd, snapshot.processId, pool);
+        }
+        
+        if (sites && snapshot.process != StringPool::Empty) {
+            if (snapshot.process != checkedProcess) {
+                checkedProcess = snapshot.process;
+                checkedIsBrowser = BrowserSiteProvider::isBrowser(pool.get(snapshot.process));
+            }
+            if (checkedIsBrowser) {
+                sites->lookup(snapshot.hwnd, snapshot.site);
+            }
+        }
+    }
+};
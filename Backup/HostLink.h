@@ -0,0 +1,259 @@
+// HostLink.h
+#pragma once
+#include <windows.h>
+#include <aclapi.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include "LoggerStats.h"
+#include "SegmentSink.h"
+#include "StringPool.h"
+
+#pragma comment(lib, "advapi32.lib")
+
+// The pipe between the per-session agents and the session host (see
+// SessionHost.h). One pipe message is a batch of segments:
+//
+//   uint32 magic, uint32 record count, then per record
+//   int64 start ms, int64 end ms (Unix epoch), and window, process, details
+//   and category as uint32 length + UTF-16 code units
+//
+// The host tells sessions apart by the pipe client's session ID, never by
+// anything in the message. Agents in turn only write to a pipe created by
+// LocalSystem and served from session 0, so another user cannot take the
+// name first and collect everyone's window titles.
+namespace host_link {
+
+static const wchar_t PipeName[] = L"\\\\.\\pipe\\ActivityLoggerHost";
+static const uint32_t Magic = 0x314b4c41;     // "ALK1"
+static const size_t MessageCapacity = 64 * 1024;
+static const size_t TextCapacity = 2048;     // longer text is cut, so a record always fits
+
+inline void putUint32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void putInt64(std::string& out, int64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void putText(std::string& out, std::wstring_view text) {
+    if (text.size() > TextCapacity) text = text.substr(0, TextCapacity);
+    putUint32(out, static_cast<uint32_t>(text.size()));
+    out.append(reinterpret_cast<const char*>(text.data()), text.size() * sizeof(wchar_t));
+}
+
+// Bounds-checked reads from one received message
+class MessageReader {
+private:
+    const char* at;
+    const char* end;
+
+    bool take(void* target, size_t bytes) {
+        if (static_cast<size_t>(end - at) < bytes) return false;
+        memcpy(target, at, bytes);
+        at += bytes;
+        return true;
+    }
+
+public:
+    MessageReader(const char* data, size_t size) : at(data), end(data + size) {}
+
+    bool uint32(uint32_t& value) { return take(&value, sizeof(value)); }
+    bool int64(int64_t& value) { return take(&value, sizeof(value)); }
+
+    // Into a reused buffer; the bytes need not be aligned
+    bool text(std::wstring& value) {
+        uint32_t length;
+        if (!uint32(length) || length > TextCapacity) return false;
+        value.resize(length);
+        return take(&value[0], length * sizeof(wchar_t));
+    }
+};
+
+// The session host service, and not a pipe some other user got to first
+inline bool isTrustedServer(HANDLE pipe) {
+    ULONG serverProcess = 0;
+    DWORD serverSession = 0;
+    if (!GetNamedPipeServerProcessId(pipe, &serverProcess) ||
+        !ProcessIdToSessionId(serverProcess, &serverSession) || serverSession != 0) {
+        return false;
+    }
+
+    PSID owner = nullptr;
+    PSECURITY_DESCRIPTOR descriptor = nullptr;
+    if (GetSecurityInfo(pipe, SE_KERNEL_OBJECT, OWNER_SECURITY_INFORMATION, &owner, NULL, NULL, NULL,
+                        &descriptor) != ERROR_SUCCESS) {
+        return false;
+    }
+    bool system = owner && IsWellKnownSid(owner, WinLocalSystemSid);
+    LocalFree(descriptor);
+    return system;
+}
+
+}
+
+// Agent mode's only sink: instead of a log file of its own, each session's
+// logger batches its segments into pipe messages for the session host. A
+// message goes once it is full, SendIntervalMs after its first record, or
+// on a flush. While the host is unreachable messages queue up to
+// MaxBacklogBytes, oldest dropped first, and the pipe is retried every
+// RetryMs.
+class HostForwardSink : public ISegmentSink {
+private:
+    static constexpr DWORD SendIntervalMs = 2000;
+    static constexpr DWORD RetryMs = 10000;
+    static constexpr size_t MaxBacklogBytes = 4 * 1024 * 1024;
+
+    const StringPool* strings;
+    HANDLE pipe;
+
+    // Sink thread only. The last message is the one being filled; the
+    // sealed ones before it add up to backlogBytes.
+    std::deque<std::string> outbox;
+    size_t backlogBytes;
+    uint32_t lastRecords;
+    ULONGLONG lastSince;
+    ULONGLONG retryAt;
+    WriterStats stats;
+    StatCounter dropped;
+
+    static int64_t epochMs(const std::chrono::system_clock::time_point& time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+
+    bool connect() {
+        if (pipe != INVALID_HANDLE_VALUE) return true;
+        if (GetTickCount64() < retryAt) return false;
+        // READ_CONTROL to check the pipe's owner before anything is sent
+        pipe = CreateFileW(host_link::PipeName, GENERIC_WRITE | READ_CONTROL, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            retryAt = GetTickCount64() + RetryMs;
+            return false;
+        }
+        if (!host_link::isTrustedServer(pipe)) {
+            disconnect();
+            return false;
+        }
+        DWORD mode = PIPE_READMODE_MESSAGE;
+        SetNamedPipeHandleState(pipe, &mode, NULL, NULL);
+        return true;
+    }
+
+    void disconnect() {
+        if (pipe != INVALID_HANDLE_VALUE) {
+            CloseHandle(pipe);
+            pipe = INVALID_HANDLE_VALUE;
+        }
+        retryAt = GetTickCount64() + RetryMs;
+    }
+
+    static uint32_t recordCount(const std::string& message) {
+        uint32_t records;
+        memcpy(&records, &message[sizeof(uint32_t)], sizeof(records));
+        return records;
+    }
+
+    // Seals the message being filled; it goes out with the next send()
+    void seal() {
+        if (lastRecords == 0) return;
+        memcpy(&outbox.back()[sizeof(uint32_t)], &lastRecords, sizeof(lastRecords));
+        backlogBytes += outbox.back().size();
+        lastRecords = 0;
+        outbox.emplace_back();
+
+        while (backlogBytes > MaxBacklogBytes && outbox.size() > 1) {
+            dropped.add(recordCount(outbox.front()));
+            backlogBytes -= outbox.front().size();
+            outbox.pop_front();
+        }
+    }
+
+    void send() {
+        while (outbox.size() > 1 && connect()) {
+            const std::string& message = outbox.front();
+            int64_t writeStart = qpcNow();
+            DWORD written = 0;
+            bool ok = WriteFile(pipe, message.data(), static_cast<DWORD>(message.size()), &written, NULL) &&
+                      written == message.size();
+            stats.write.record(writeStart);
+            if (!ok) {
+                stats.failedWrites.add();
+                disconnect();
+                return;
+            }
+            stats.records.add(recordCount(message));
+            stats.bytes.add(written);
+            backlogBytes -= message.size();
+            outbox.pop_front();
+        }
+    }
+
+public:
+    // The pool must outlive the sink
+    explicit HostForwardSink(const StringPool& pool)
+        : strings(&pool), pipe(INVALID_HANDLE_VALUE), backlogBytes(0), lastRecords(0), lastSince(0), retryAt(0) {
+        outbox.emplace_back();
+    }
+
+    ~HostForwardSink() {
+        close();
+    }
+
+    const char* name() const override { return "Host"; }
+
+    void consume(LogRecord&& record) override {
+        int64_t formatStart = qpcNow();
+        std::string* message = &outbox.back();
+        size_t worstCase = 2 * sizeof(int64_t) + 4 * (sizeof(uint32_t) + host_link::TextCapacity * sizeof(wchar_t));
+        if (lastRecords > 0 && message->size() + worstCase > host_link::MessageCapacity) {
+            seal();
+            message = &outbox.back();
+        }
+        if (message->empty()) {
+            host_link::putUint32(*message, host_link::Magic);
+            host_link::putUint32(*message, 0);
+            lastSince = GetTickCount64();
+        }
+        host_link::putInt64(*message, epochMs(record.start));
+        host_link::putInt64(*message, epochMs(record.end));
+        host_link::putText(*message, record.window);
+        host_link::putText(*message, strings->get(record.process));
+        host_link::putText(*message, strings->get(record.details));
+        host_link::putText(*message, strings->get(record.category));
+        lastRecords++;
+        stats.format.record(formatStart);
+    }
+
+    DWORD service(bool force) override {
+        ULONGLONG now = GetTickCount64();
+        if (lastRecords > 0 && (force || now - lastSince >= SendIntervalMs)) {
+            seal();
+        }
+        send();
+
+        ULONGLONG wait = INFINITE;
+        if (outbox.size() > 1) {
+            wait = (retryAt > now) ? retryAt - now : 0;
+        } else if (lastRecords > 0) {
+            ULONGLONG age = now - lastSince;
+            wait = (age >= SendIntervalMs) ? 0 : SendIntervalMs - age;
+        }
+        return static_cast<DWORD>(wait);
+    }
+
+    void close() override {
+        if (pipe != INVALID_HANDLE_VALUE) {
+            CloseHandle(pipe);
+            pipe = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    // Sink-thread counters; safe to read from any thread. records and bytes
+    // count what reached the host.
+    const WriterStats& getStats() const { return stats; }
+    uint64_t getDropped() const { return dropped.get(); }
+};
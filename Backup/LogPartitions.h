@@ -0,0 +1,249 @@
+// LogPartitions.h
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Settings.h"
+
+// Splits the log into time- or size-bounded partition files next to the
+// configured log path and keeps a small index of them:
+//
+//   PC_ActivityLog.csv          Partition=none (default), one growing file
+//   PC_ActivityLog_2024-05.csv  Partition=monthly, by each row's start time
+//   PC_ActivityLog_007.csv      Partition=size, a new file every PartitionSizeMB
+//   PC_ActivityLog_Index.csv    one line per partition
+//
+// The index lists each partition's file name, the first start and last end
+// time it holds (seconds since the Unix epoch), its row count, its size in
+// bytes and offset checkpoints, so a reader can go straight to the files
+// covering a date range and sync tools only see the active partition change.
+//
+// A checkpoint, written offset:endBefore and ';'-separated, is taken about
+// every CheckpointBytes of rows. endBefore is the latest end of any row
+// before offset (the .seg file's, for the binary format), so a reader after
+// rows ending past T can skip to the last checkpoint with endBefore <= T.
+struct PartitionCheckpoint {
+    uint64_t offset;
+    int64_t endBefore;
+};
+
+struct PartitionInfo {
+    std::string name;
+    int64_t firstStart = 0;
+    int64_t lastEnd = 0;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    std::vector<PartitionCheckpoint> checkpoints;
+};
+
+class LogPartitions {
+public:
+    static constexpr uint64_t CheckpointBytes = 256 * 1024;
+
+private:
+    PartitionMode mode = PartitionMode::None;
+    uint64_t maxBytes = 0;
+    std::string folder;       // with trailing separator
+    std::string stem;         // file name without extension
+    std::string extension;    // including the dot
+    std::vector<PartitionInfo> partitions;
+    bool dirty = false;
+
+    std::string indexPath() const {
+        return folder + stem + "_Index.csv";
+    }
+
+    // The number in a size partition's name, or 0 if it has none
+    unsigned sequenceOf(const std::string& name) const {
+        std::string prefix = stem + "_";
+        if (name.compare(0, prefix.size(), prefix) != 0) return 0;
+        const char* digits = name.c_str() + prefix.size();
+        if (*digits < '0' || *digits > '9') return 0;
+        return static_cast<unsigned>(std::strtoul(digits, nullptr, 10));
+    }
+
+    PartitionInfo* find(const std::string& name) {
+        for (auto& partition : partitions) {
+            if (partition.name == name) return &partition;
+        }
+        return nullptr;
+    }
+
+    void loadIndex() {
+        partitions.clear();
+        std::ifstream file(indexPath());
+        std::string line;
+        std::getline(file, line); // header
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            PartitionInfo info;
+            std::string value;
+            if (!std::getline(fields, info.name, ',')) continue;
+            if (std::getline(fields, value, ',')) info.firstStart = std::strtoll(value.c_str(), nullptr, 10);
+            if (std::getline(fields, value, ',')) info.lastEnd = std::strtoll(value.c_str(), nullptr, 10);
+            if (std::getline(fields, value, ',')) info.rows = std::strtoull(value.c_str(), nullptr, 10);
+            if (std::getline(fields, value, ',')) info.bytes = std::strtoull(value.c_str(), nullptr, 10);
+            if (std::getline(fields, value, ',')) {
+                const char* cursor = value.c_str();
+                while (*cursor) {
+                    char* next;
+                    PartitionCheckpoint checkpoint;
+                    checkpoint.offset = std::strtoull(cursor, &next, 10);
+                    if (*next != ':') break;
+                    checkpoint.endBefore = std::strtoll(next + 1, &next, 10);
+                    info.checkpoints.push_back(checkpoint);
+                    cursor = (*next == ';') ? next + 1 : next;
+                }
+            }
+            if (!info.name.empty()) partitions.push_back(info);
+        }
+    }
+
+public:
+    void configure(const std::string& logPath, PartitionMode partitionMode, uint64_t partitionBytes) {
+        mode = partitionMode;
+        maxBytes = partitionBytes;
+
+        size_t slash = logPath.find_last_of("\\/");
+        folder = (slash != std::string::npos) ? logPath.substr(0, slash + 1) : "";
+        std::string name = logPath.substr(folder.size());
+        size_t dot = name.find_last_of('.');
+        stem = (dot != std::string::npos) ? name.substr(0, dot) : name;
+        extension = (dot != std::string::npos) ? name.substr(dot) : "";
+
+        if (mode != PartitionMode::None) {
+            loadIndex();
+        }
+    }
+
+    bool isPartitioned() const { return mode != PartitionMode::None; }
+
+    // Full path of a partition listed in the index
+    std::string pathOf(const std::string& name) const { return folder + name; }
+
+    // Full path of the file a row starting at start belongs in
+    std::string pathFor(time_t start) const {
+        char suffix[32];
+        switch (mode) {
+            case PartitionMode::Monthly: {
+                struct tm local;
+                if (localtime_s(&local, &start) != 0) break;
+                snprintf(suffix, sizeof(suffix), "_%04d-%02d", local.tm_year + 1900, local.tm_mon + 1);
+                return folder + stem + suffix + extension;
+            }
+            case PartitionMode::Size: {
+                // Rows always go to the newest partition until it is full.
+                // Its number comes from its name, as the index may have lost
+                // entries or gained unrelated ones.
+                unsigned sequence = 1;
+                if (!partitions.empty()) {
+                    const std::string& newest = partitions.back().name;
+                    sequence = sequenceOf(newest);
+                    if (sequence == 0) sequence = static_cast<unsigned>(partitions.size());
+                    bool compacted = newest.size() < extension.size() ||
+                                     newest.compare(newest.size() - extension.size(), extension.size(), extension) != 0;
+                    if (compacted || partitions.back().bytes >= maxBytes) sequence++;
+                }
+                snprintf(suffix, sizeof(suffix), "_%03u", sequence);
+                return folder + stem + suffix + extension;
+            }
+            case PartitionMode::None:
+                break;
+        }
+        return folder + stem + extension;
+    }
+
+    // Accounts rows just appended to path at rowsOffset, after which its
+    // size is fileBytes
+    void recordWritten(const std::string& path, int64_t firstStart, int64_t lastEnd,
+                       uint64_t rows, uint64_t fileBytes, uint64_t rowsOffset) {
+        if (mode == PartitionMode::None || rows == 0) return;
+
+        std::string name = path.substr(folder.size());
+        PartitionInfo* partition = find(name);
+        if (!partition) {
+            partitions.push_back(PartitionInfo());
+            partition = &partitions.back();
+            partition->name = name;
+            partition->firstStart = firstStart;
+        }
+        uint64_t lastCheckpoint = partition->checkpoints.empty() ? 0 : partition->checkpoints.back().offset;
+        if (rowsOffset >= lastCheckpoint + CheckpointBytes) {
+            partition->checkpoints.push_back(PartitionCheckpoint{ rowsOffset, partition->lastEnd });
+        }
+        if (firstStart < partition->firstStart) partition->firstStart = firstStart;
+        if (lastEnd > partition->lastEnd) partition->lastEnd = lastEnd;
+        partition->rows += rows;
+        partition->bytes = fileBytes;
+        dirty = true;
+    }
+
+    // A partition now stored as coldPath (ColdStorage.h), coldBytes long. If
+    // the cold file already had an entry the rows were merged into it. The
+    // checkpoints only apply to the old file and are dropped.
+    void recordCompacted(const std::string& path, const std::string& coldPath, uint64_t coldBytes) {
+        PartitionInfo* partition = find(path.substr(folder.size()));
+        if (!partition) return;
+        std::string coldName = coldPath.substr(folder.size());
+        PartitionInfo* cold = find(coldName);
+        if (cold) {
+            if (partition->firstStart < cold->firstStart) cold->firstStart = partition->firstStart;
+            if (partition->lastEnd > cold->lastEnd) cold->lastEnd = partition->lastEnd;
+            cold->rows += partition->rows;
+            cold->bytes = coldBytes;
+            cold->checkpoints.clear();
+            partitions.erase(partitions.begin() + (partition - partitions.data()));
+        } else {
+            partition->name = coldName;
+            partition->bytes = coldBytes;
+            partition->checkpoints.clear();
+        }
+        dirty = true;
+    }
+
+    // Rewrites the index through a temporary file so readers never see a
+    // half-written one
+    bool saveIndex() {
+        if (!dirty) return true;
+
+        std::string text = "Partition,FirstStart,LastEnd,Rows,Bytes,Checkpoints\n";
+        for (const auto& partition : partitions) {
+            char numbers[96];
+            snprintf(numbers, sizeof(numbers), ",%lld,%lld,%llu,%llu,",
+                     static_cast<long long>(partition.firstStart), static_cast<long long>(partition.lastEnd),
+                     static_cast<unsigned long long>(partition.rows), static_cast<unsigned long long>(partition.bytes));
+            text += partition.name;
+            text += numbers;
+            for (size_t i = 0; i < partition.checkpoints.size(); i++) {
+                snprintf(numbers, sizeof(numbers), "%s%llu:%lld", i ? ";" : "",
+                         static_cast<unsigned long long>(partition.checkpoints[i].offset),
+                         static_cast<long long>(partition.checkpoints[i].endBefore));
+                text += numbers;
+            }
+            text += '\n';
+        }
+
+        std::string target = indexPath();
+        std::string temp = target + ".tmp";
+        HANDLE file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        DWORD written = 0;
+        bool ok = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, NULL) &&
+                  written == text.size();
+        CloseHandle(file);
+        if (!ok || !MoveFileExA(temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileA(temp.c_str());
+            return false;
+        }
+        dirty = false;
+        return true;
+    }
+
+    const std::vector<PartitionInfo>& list() const { return partitions; }
+};
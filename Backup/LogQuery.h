@@ -0,0 +1,173 @@
+// LogQuery.h
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CsvFormat.h"
+#include "CsvReader.h"
+
+// Time-range and category queries over one CSV log without loading it. A
+// sparse index keeps one entry per RowsPerEntry rows with the entry's first
+// row offset, so a query binary-searches to the rows that can overlap the
+// range and streams only those:
+//
+//   maxEnd    latest end of any row up to and including the entry
+//   minStart  earliest start of any row from the entry on
+//
+// Both are monotonic even when a recovered journal segment lands out of
+// order. The index lives in memory and is extended, never rebuilt, as the
+// log grows; a file that shrank (rotated, replaced) is indexed afresh.
+//
+// Times are local seconds since 1970-01-01 00:00, as the log writes them
+// (csv_format_detail::parseTimestamp). Categories are bits of a 64-bit mask
+// handed out in order of first sight by categoryBit(); the 64th and later
+// categories share the last bit. A mask of 0 matches every category.
+class LogQuery {
+public:
+    static constexpr size_t RowsPerEntry = 256;
+    static constexpr uint64_t AllCategories = 0;
+
+    // One matching row, valid for the duration of the callback. raw is the
+    // row as it is in the file, line ending included.
+    struct Match {
+        int64_t start;
+        int64_t end;
+        std::string_view category;
+        const CsvReader::Row* row;
+        std::string_view raw;
+    };
+
+private:
+    struct Entry {
+        size_t offset;
+        int64_t maxEnd;
+        int64_t minStart;
+    };
+
+    std::string path;
+    std::vector<Entry> entries;
+    size_t indexedBytes;        // up to the end of the last complete row
+    size_t rowsInLast;          // rows in the last entry so far
+    int64_t latestEnd;
+
+    std::unordered_map<std::string, unsigned> categoryBits;
+    std::string key;
+    std::string unescaped;
+
+    // Start and end of a data row; false for the header and malformed rows
+    static bool rowTimes(const CsvReader::Row& row, int64_t& start, int64_t& end) {
+        using namespace csv_format_detail;
+        int64_t duration;
+        if (row.count < 7 || row.escaped[0] || row.escaped[2] || !parseTimestamp(row.fields[0], start) ||
+            !parseInteger(row.fields[2], duration) || duration < 0) {
+            return false;
+        }
+        end = start + duration;
+        return true;
+    }
+
+    // A row still being appended has no newline yet and is left for later
+    static size_t completeRows(const char* data, size_t size) {
+        while (size > 0 && data[size - 1] != '\n') size--;
+        return size;
+    }
+
+    void reset() {
+        entries.clear();
+        indexedBytes = 0;
+        rowsInLast = 0;
+        latestEnd = INT64_MIN;
+    }
+
+    void extend(CsvReader& reader) {
+        size_t size = completeRows(reader.begin(), reader.length());
+        if (size < indexedBytes) reset();
+        if (size == indexedBytes) return;
+
+        size_t firstNew = entries.size();
+        CsvReader rows;
+        rows.attach(reader.begin(), size, indexedBytes);
+        CsvReader::Row row;
+        while (rows.next(row)) {
+            int64_t start, end;
+            if (!rowTimes(row, start, end)) continue;
+            if (entries.empty() || rowsInLast == RowsPerEntry) {
+                entries.push_back(Entry{ row.offset, latestEnd, INT64_MAX });
+                rowsInLast = 0;
+            }
+            rowsInLast++;
+            latestEnd = std::max(latestEnd, end);
+            entries.back().maxEnd = latestEnd;
+            entries.back().minStart = std::min(entries.back().minStart, start);
+        }
+        indexedBytes = size;
+
+        // New rows can only lower minStart of the entries before them
+        if (firstNew == entries.size()) firstNew = entries.empty() ? 0 : entries.size() - 1;
+        int64_t earliest = INT64_MAX;
+        for (size_t i = entries.size(); i-- > 0;) {
+            earliest = std::min(earliest, entries[i].minStart);
+            if (i < firstNew && entries[i].minStart <= earliest) break;
+            entries[i].minStart = earliest;
+        }
+    }
+
+public:
+    explicit LogQuery(const std::string& csvPath) : path(csvPath) {
+        reset();
+    }
+
+    LogQuery(const LogQuery&) = delete;
+    LogQuery& operator=(const LogQuery&) = delete;
+
+    // The mask bit for a category name, assigning the next free one
+    uint64_t categoryBit(std::string_view name) {
+        key.assign(name.data(), name.size());
+        auto it = categoryBits.find(key);
+        if (it == categoryBits.end()) {
+            unsigned bit = static_cast<unsigned>(std::min<size_t>(categoryBits.size(), 63));
+            it = categoryBits.emplace(key, bit).first;
+        }
+        return 1ULL << it->second;
+    }
+
+    const std::string& getPath() const { return path; }
+    size_t indexEntries() const { return entries.size(); }
+
+    // Calls onMatch(const Match&) for every row overlapping [start, end)
+    // whose category is in categoryMask, in file order. Returns false if the
+    // log could not be opened.
+    template <typename OnMatch>
+    bool queryRange(int64_t start, int64_t end, uint64_t categoryMask, OnMatch&& onMatch) {
+        CsvReader reader;
+        if (!reader.open(path)) return false;
+        extend(reader);
+        if (start >= end || entries.empty()) return true;
+
+        // First entry that reaches past start, first that begins at or after end
+        auto first = std::partition_point(entries.begin(), entries.end(),
+                                          [&](const Entry& entry) { return entry.maxEnd <= start; });
+        auto last = std::partition_point(first, entries.end(),
+                                         [&](const Entry& entry) { return entry.minStart < end; });
+        if (first == last) return true;
+
+        size_t stop = (last == entries.end()) ? indexedBytes : last->offset;
+        CsvReader rows;
+        rows.attach(reader.begin(), stop, first->offset);
+        CsvReader::Row row;
+        while (rows.next(row)) {
+            Match match;
+            if (!rowTimes(row, match.start, match.end) || match.end <= start || match.start >= end) continue;
+            match.category = row.text(6, unescaped);
+            if (categoryMask != AllCategories && !(categoryMask & categoryBit(match.category))) continue;
+            match.row = &row;
+            match.raw = std::string_view(reader.begin() + row.offset, rows.offset() - row.offset);
+            onMatch(match);
+        }
+        return true;
+    }
+};
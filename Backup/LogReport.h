@@ -0,0 +1,329 @@
+// LogReport.h
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ColdStorage.h"
+#include "CsvFormat.h"
+#include "CsvReader.h"
+#include "SegmentLog.h"
+
+// Builds one report from the logs of many machines collected in a folder
+// (e.g. a shared OneDrive folder of <Computer>_ActivityLog*.csv files, and
+// the .cold files ColdStorage.h compacts closed partitions into).
+// Machines are independent, so each one is a task on a small worker pool:
+// its files (partitions included) are parsed with CsvReader, its segments
+// merged in start order with overlaps trimmed so a row present in two files
+// counts once, and the result folded into day x category totals. Only the
+// totals outlive a task, so memory stays bounded by the number of workers.
+//
+//   Machine,Day,Category,Seconds,Segments,LongestSeconds
+//   "DESKTOP-01",2024-05-21,"Development",11520,84,2710
+//
+// Times in the log are local, and days are the local days they name. A
+// report can be limited to a range of them; segments are clipped to it and
+// a .cold file whose header rules the range out is not decompressed.
+namespace log_report_detail {
+
+using namespace csv_format_detail;
+
+struct Segment {
+    int64_t start;      // local time as seconds since 1970-01-01 00:00
+    int64_t end;
+    uint32_t category;
+};
+
+struct Totals {
+    int64_t seconds = 0;
+    uint32_t segments = 0;
+    int64_t longest = 0;
+};
+
+struct Machine {
+    std::string name;
+    std::vector<std::string> files;
+    uint64_t bytes = 0;
+
+    // Filled by the worker
+    std::vector<std::string> categories;
+    std::unordered_map<uint64_t, Totals> totals;    // by totalsKey(day number, category)
+    uint64_t rows = 0;
+    uint64_t badRows = 0;
+    unsigned failedFiles = 0;
+    unsigned skippedFiles = 0;
+};
+
+inline uint64_t totalsKey(int64_t day, uint32_t category) {
+    return (static_cast<uint64_t>(day + 0x80000000LL) << 32) | category;
+}
+
+inline int64_t dayOfKey(uint64_t key) { return static_cast<int64_t>(key >> 32) - 0x80000000LL; }
+inline uint32_t categoryOfKey(uint64_t key) { return static_cast<uint32_t>(key); }
+
+class MachineWorker {
+private:
+    Machine& machine;
+    int64_t rangeStart;
+    int64_t rangeEnd;
+    std::unordered_map<std::string, uint32_t> categoryIds;
+    std::string scratch;
+    std::vector<Segment> segments;
+
+    uint32_t categoryId(std::string_view name) {
+        scratch.assign(name.data(), name.size());
+        auto it = categoryIds.find(scratch);
+        if (it != categoryIds.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(machine.categories.size());
+        machine.categories.push_back(scratch);
+        categoryIds.emplace(scratch, id);
+        return id;
+    }
+
+    bool limited() const { return rangeStart != INT64_MIN || rangeEnd != INT64_MAX; }
+
+    void addSegment(const Segment& segment) {
+        if (segment.end > rangeStart && segment.start < rangeEnd) segments.push_back(segment);
+    }
+
+    void parseColdFile(const std::string& path) {
+        ColdLogHeader header;
+        if (limited() && ColdLogReader::readHeader(path, header) &&
+            !ColdLogReader::mayOverlap(header, rangeStart, rangeEnd)) {
+            machine.skippedFiles++;
+            return;
+        }
+        ColdLogReader reader;
+        if (!reader.open(path)) {
+            machine.failedFiles++;
+            return;
+        }
+        ColdRow row;
+        uint32_t decoded = 0;
+        while (reader.next(row)) {
+            decoded++;
+            if (row.duration < 0) {
+                machine.badRows++;
+                continue;
+            }
+            addSegment(Segment{ row.start, row.start + row.duration, categoryId(row.category) });
+            machine.rows++;
+        }
+        machine.badRows += reader.rows() - decoded;
+    }
+
+    void parseFile(const std::string& path) {
+        if (isColdLogPath(path)) {
+            parseColdFile(path);
+            return;
+        }
+        CsvReader reader;
+        if (!reader.open(path)) {
+            machine.failedFiles++;
+            return;
+        }
+        CsvReader::Row row;
+        std::string unescaped;
+        bool first = true;
+        while (reader.next(row)) {
+            if (first) {
+                first = false;
+                if (row.count > 0 && row.fields[0] == "StartTime") continue;
+            }
+            if (row.count == 1 && row.fields[0].empty()) continue; // blank line
+
+            Segment segment;
+            int64_t duration;
+            if (row.count < 7 || row.escaped[0] || row.escaped[2] ||
+                !parseTimestamp(row.fields[0], segment.start) || !parseInteger(row.fields[2], duration) ||
+                duration < 0) {
+                machine.badRows++;
+                continue;
+            }
+            // DurationSeconds is measured on the monotonic clock, so it stays
+            // right across a DST change where EndTime - StartTime would not
+            segment.end = segment.start + duration;
+            segment.category = categoryId(row.text(6, unescaped));
+            addSegment(segment);
+            machine.rows++;
+        }
+    }
+
+    void accumulate(int64_t start, int64_t end, uint32_t category) {
+        while (start < end) {
+            int64_t day = (start >= 0 ? start : start - 86399) / 86400;
+            int64_t pieceEnd = std::min(end, (day + 1) * 86400);
+            int64_t seconds = pieceEnd - start;
+            Totals& totals = machine.totals[totalsKey(day, category)];
+            totals.seconds += seconds;
+            totals.segments++;
+            if (seconds > totals.longest) totals.longest = seconds;
+            start = pieceEnd;
+        }
+    }
+
+public:
+    // Only time in [start, end), local seconds, is counted
+    MachineWorker(Machine& target, int64_t start, int64_t end) : machine(target), rangeStart(start), rangeEnd(end) {}
+
+    void run() {
+        for (const auto& file : machine.files) {
+            parseFile(file);
+        }
+        std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) {
+            return a.start < b.start || (a.start == b.start && a.end > b.end);
+        });
+
+        // One machine is in one place at a time: time already covered by an
+        // earlier segment (duplicate rows, a recovered journal segment) is
+        // trimmed off the later one
+        int64_t covered = INT64_MIN;
+        for (const auto& segment : segments) {
+            int64_t start = std::max({ segment.start, covered, rangeStart });
+            int64_t end = std::min(segment.end, rangeEnd);
+            if (end > start) accumulate(start, end, segment.category);
+            covered = std::max(covered, segment.end);
+        }
+        std::vector<Segment>().swap(segments);
+    }
+};
+
+// Machine name from "<name>_ActivityLog[...].csv" (or .cold), or empty for
+// other files
+inline std::string machineOf(const std::string& fileName) {
+    size_t marker = fileName.find("_ActivityLog");
+    if (marker == std::string::npos || marker == 0) return "";
+    std::string suffix = fileName.substr(marker);
+    // Side files next to the logs are not logs themselves; _Export.csv is a
+    // snapshot the viewer renders from a binary log
+    for (const char* side : { "_Index.csv", "_Totals.csv", "_Export.csv" }) {
+        size_t length = strlen(side);
+        if (suffix.size() >= length && _stricmp(suffix.c_str() + suffix.size() - length, side) == 0) return "";
+    }
+    return fileName.substr(0, marker);
+}
+
+}
+
+struct LogReportSummary {
+    size_t machines = 0;
+    size_t files = 0;
+    size_t failedFiles = 0;
+    uint64_t rows = 0;
+    uint64_t badRows = 0;
+    size_t skippedFiles = 0;    // ruled out by a cold file's header
+};
+
+// Writes the report for every log in folder to outPath, counting only time
+// in [rangeStart, rangeEnd). threads = 0 uses one worker per logical
+// processor. Returns false if no log was found or the report could not be
+// written.
+inline bool writeLogReport(const std::string& folder, const std::string& outPath, unsigned threads,
+                           LogReportSummary& summary, int64_t rangeStart = INT64_MIN,
+                           int64_t rangeEnd = INT64_MAX) {
+    using namespace log_report_detail;
+    summary = LogReportSummary();
+
+    std::string directory = folder;
+    if (!directory.empty() && directory.back() != '\\' && directory.back() != '/') directory += '\\';
+
+    std::map<std::string, Machine> byName;
+    for (const char* pattern : { "*_ActivityLog*.csv", "*_ActivityLog*.cold" }) {
+        WIN32_FIND_DATAA found;
+        HANDLE search = FindFirstFileA((directory + pattern).c_str(), &found);
+        if (search == INVALID_HANDLE_VALUE) continue;
+        do {
+            if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+            std::string name = machineOf(found.cFileName);
+            if (name.empty()) continue;
+            Machine& machine = byName[name];
+            machine.name = name;
+            machine.files.push_back(directory + found.cFileName);
+            machine.bytes += (static_cast<uint64_t>(found.nFileSizeHigh) << 32) | found.nFileSizeLow;
+            summary.files++;
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+    }
+    if (byName.empty()) return false;
+
+    std::vector<Machine*> machines;
+    for (auto& entry : byName) {
+        machines.push_back(&entry.second);
+    }
+    // Largest first, so one big machine does not start last and hold up the end
+    std::vector<Machine*> queue = machines;
+    std::sort(queue.begin(), queue.end(), [](const Machine* a, const Machine* b) { return a->bytes > b->bytes; });
+
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > queue.size()) threads = static_cast<unsigned>(queue.size());
+
+    std::atomic<size_t> nextTask(0);
+    auto work = [&]() {
+        for (size_t task; (task = nextTask.fetch_add(1)) < queue.size();) {
+            MachineWorker(*queue[task], rangeStart, rangeEnd).run();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& worker : pool) {
+        worker.join();
+    }
+
+    std::string text = "Machine,Day,Category,Seconds,Segments,LongestSeconds\n";
+    for (const Machine* machine : machines) {
+        summary.machines++;
+        summary.rows += machine->rows;
+        summary.badRows += machine->badRows;
+        summary.failedFiles += machine->failedFiles;
+        summary.skippedFiles += machine->skippedFiles;
+
+        // Within a day, categories in name order
+        std::vector<uint32_t> order(machine->categories.size());
+        std::vector<uint32_t> rank(machine->categories.size());
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return machine->categories[a] < machine->categories[b];
+        });
+        for (uint32_t i = 0; i < order.size(); i++) rank[order[i]] = i;
+
+        std::vector<std::pair<uint64_t, Totals>> rows(machine->totals.begin(), machine->totals.end());
+        std::sort(rows.begin(), rows.end(), [&](const auto& a, const auto& b) {
+            if (dayOfKey(a.first) != dayOfKey(b.first)) return dayOfKey(a.first) < dayOfKey(b.first);
+            return rank[categoryOfKey(a.first)] < rank[categoryOfKey(b.first)];
+        });
+
+        for (const auto& row : rows) {
+            char day[11];
+            char numbers[80];
+            formatDay(dayOfKey(row.first), day);
+            appendCsvQuoted(text, machine->name);
+            text += ',';
+            text += day;
+            text += ',';
+            appendCsvQuoted(text, machine->categories[categoryOfKey(row.first)]);
+            snprintf(numbers, sizeof(numbers), ",%lld,%u,%lld\n", static_cast<long long>(row.second.seconds),
+                     row.second.segments, static_cast<long long>(row.second.longest));
+            text += numbers;
+        }
+    }
+
+    HANDLE out = CreateFileA(outPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out == INVALID_HANDLE_VALUE) return false;
+    bool ok = segment_log_detail::writeAll(out, text.data(), text.size());
+    CloseHandle(out);
+    return ok;
+}
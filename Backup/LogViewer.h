@@ -0,0 +1,334 @@
+// LogViewer.h
+#pragma once
+#include <windows.h>
+#include <commctrl.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ColdStorage.h"
+#include "CsvReader.h"
+
+// Native window over a CSV log. The file is memory-mapped and shown in a
+// virtual (LVS_OWNERDATA) ListView: the window opens as soon as the mapping
+// exists, a background thread finds row boundaries and grows the item count
+// as it goes, and a row is only split into fields when the list asks to draw
+// it. Nothing is copied out of the mapping except the row on screen.
+//
+// The viewer is a snapshot of the file as it was when opened. A compacted
+// partition (ColdStorage.h) is decoded to CSV text in memory instead.
+// openRows() shows only the given rows, e.g. a LogQuery result, and skips
+// the indexer.
+class LogViewer {
+private:
+    static constexpr UINT RowsIndexedMessage = WM_APP + 1;
+    static constexpr size_t IndexBatch = 16384;
+    static constexpr int ColumnCount = 7;
+
+    HWND window;
+    HWND list;
+    HANDLE file;
+    HANDLE mapping;
+    const char* data;
+    size_t size;
+    std::string decoded;        // the whole CSV, when opened from a cold file
+    std::function<void()> onClosed;
+
+    // Start offset of every data row; appended by the indexer in batches
+    std::vector<size_t> rowStarts;
+    std::mutex rowsMutex;
+    std::thread indexer;
+    std::atomic<bool> cancelIndexing;
+
+    // UI thread: the row LVN_GETDISPINFO last asked for, split into fields
+    // that still point into the mapping
+    size_t cachedRow;
+    CsvReader::Row fields;
+    std::wstring wideText;      // the requested field as UTF-16, before cutting
+    std::string unescaped;
+
+    // The reader keeps quoted newlines inside their field, so every offset
+    // it stops at is a real row start
+    void indexRows(size_t offset) {
+        std::vector<size_t> batch;
+        batch.reserve(IndexBatch);
+        CsvReader reader;
+        reader.attach(data, size, offset);
+        CsvReader::Row row;
+        while (!cancelIndexing && reader.next(row)) {
+            if (reader.offset() < size) {
+                batch.push_back(reader.offset());
+                if (batch.size() == IndexBatch) {
+                    publishRows(batch);
+                }
+            }
+        }
+        publishRows(batch);
+    }
+
+    void publishRows(std::vector<size_t>& batch) {
+        if (batch.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(rowsMutex);
+            rowStarts.insert(rowStarts.end(), batch.begin(), batch.end());
+        }
+        batch.clear();
+        PostMessageW(window, RowsIndexedMessage, 0, 0);
+    }
+
+    size_t headerEnd() const {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', size));
+        return newline ? static_cast<size_t>(newline - data) + 1 : size;
+    }
+
+    void fillItem(LVITEMW& item) {
+        if (!(item.mask & LVIF_TEXT) || item.cchTextMax <= 0) return;
+        item.pszText[0] = L'\0';
+        if (item.iSubItem < 0 || item.iSubItem >= ColumnCount) return;
+
+        size_t row = static_cast<size_t>(item.iItem);
+        if (row != cachedRow) {
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(rowsMutex);
+                if (row >= rowStarts.size()) return;
+                begin = rowStarts[row];
+                end = row + 1 < rowStarts.size() ? rowStarts[row + 1] : size;
+            }
+            CsvReader reader;
+            reader.attach(data, end, begin);
+            reader.next(fields);
+            cachedRow = row;
+        }
+
+        if (item.cchTextMax <= 0) return;
+        std::string_view text = fields.text(static_cast<size_t>(item.iSubItem), unescaped);
+        int length = text.empty() ? 0 : MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                                            nullptr, 0);
+        wideText.resize(length > 0 ? static_cast<size_t>(length) : 0);
+        if (length > 0) {
+            MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &wideText[0], length);
+        }
+
+        // The list's buffer is about 260 units; a longer field is cut and
+        // ends in an ellipsis, like a cut TitleBuffer
+        size_t room = static_cast<size_t>(item.cchTextMax - 1);
+        size_t copied = wideText.size();
+        if (copied > room) {
+            copied = room;
+            if (copied > 0) {
+                if (copied > 1 && IS_HIGH_SURROGATE(wideText[copied - 2])) copied--;
+                wideText[copied - 1] = L'\x2026';
+            }
+        }
+        wmemcpy(item.pszText, wideText.data(), copied);
+        item.pszText[copied] = L'\0';
+    }
+
+    void createColumns() {
+        static const wchar_t* names[ColumnCount] = {
+            L"Start", L"End", L"Seconds", L"Window Title", L"Details", L"Process", L"Category"
+        };
+        static const int widths[ColumnCount] = { 130, 130, 60, 360, 240, 120, 120 };
+
+        LVCOLUMNW column = {};
+        column.mask = LVCF_TEXT | LVCF_WIDTH | LVCF_SUBITEM | LVCF_FMT;
+        for (int i = 0; i < ColumnCount; i++) {
+            column.fmt = (i == 2) ? LVCFMT_RIGHT : LVCFMT_LEFT;
+            column.pszText = const_cast<wchar_t*>(names[i]);
+            column.cx = widths[i];
+            column.iSubItem = i;
+            SendMessageW(list, LVM_INSERTCOLUMNW, i, reinterpret_cast<LPARAM>(&column));
+        }
+    }
+
+    LRESULT handleMessage(UINT message, WPARAM wParam, LPARAM lParam) {
+        switch (message) {
+            case WM_CREATE: {
+                list = CreateWindowExW(0, WC_LISTVIEWW, L"",
+                                       WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_OWNERDATA | LVS_SHOWSELALWAYS,
+                                       0, 0, 0, 0, window, NULL, GetModuleHandleW(NULL), NULL);
+                SendMessageW(list, LVM_SETEXTENDEDLISTVIEWSTYLE, 0, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+                createColumns();
+                return 0;
+            }
+
+            case WM_SIZE:
+                MoveWindow(list, 0, 0, LOWORD(lParam), HIWORD(lParam), TRUE);
+                return 0;
+
+            case RowsIndexedMessage: {
+                size_t count;
+                {
+                    std::lock_guard<std::mutex> lock(rowsMutex);
+                    count = rowStarts.size();
+                }
+                // The last row's end moves as rows are added after it
+                cachedRow = SIZE_MAX;
+                SendMessageW(list, LVM_SETITEMCOUNT, count, LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+                return 0;
+            }
+
+            case WM_NOTIFY: {
+                NMHDR* header = reinterpret_cast<NMHDR*>(lParam);
+                if (header->hwndFrom == list && header->code == LVN_GETDISPINFOW) {
+                    fillItem(reinterpret_cast<NMLVDISPINFOW*>(lParam)->item);
+                }
+                return 0;
+            }
+
+            case WM_DESTROY:
+                close();
+                if (onClosed) onClosed();
+                return 0;
+
+            case WM_NCDESTROY:
+                SetWindowLongPtrW(window, GWLP_USERDATA, 0);
+                window = nullptr;
+                list = nullptr;
+                return 0;
+        }
+        return DefWindowProcW(window, message, wParam, lParam);
+    }
+
+    static LRESULT CALLBACK windowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
+        if (message == WM_NCCREATE) {
+            LogViewer* viewer = static_cast<LogViewer*>(reinterpret_cast<CREATESTRUCTW*>(lParam)->lpCreateParams);
+            viewer->window = hwnd;
+            SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(viewer));
+        }
+        LogViewer* viewer = reinterpret_cast<LogViewer*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+        return viewer ? viewer->handleMessage(message, wParam, lParam) : DefWindowProcW(hwnd, message, wParam, lParam);
+    }
+
+    // Stops the indexer and releases the mapping
+    void close() {
+        cancelIndexing = true;
+        if (indexer.joinable()) indexer.join();
+        if (data && mapping) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        std::string().swap(decoded);
+        data = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        size = 0;
+        cachedRow = SIZE_MAX;
+        std::lock_guard<std::mutex> lock(rowsMutex);
+        rowStarts.clear();
+    }
+
+    // Maps csvPath read-only; the file stays writable by the logger
+    bool mapFile(const std::string& csvPath) {
+        file = CreateFileA(csvPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Creates the window over data and, unless the rows are already known,
+    // starts indexing it
+    bool show(const std::wstring& title, std::function<void()> closed, bool indexAll = true) {
+        static bool registered = false;
+        if (!registered) {
+            WNDCLASSEXW wc = {};
+            wc.cbSize = sizeof(wc);
+            wc.lpfnWndProc = windowProc;
+            wc.hInstance = GetModuleHandleW(NULL);
+            wc.hCursor = LoadCursorW(NULL, IDC_ARROW);
+            wc.lpszClassName = L"ActivityLoggerViewer";
+            registered = RegisterClassExW(&wc) != 0;
+        }
+
+        INITCOMMONCONTROLSEX controls = { sizeof(controls), ICC_LISTVIEW_CLASSES };
+        InitCommonControlsEx(&controls);
+
+        onClosed = std::move(closed);
+        CreateWindowExW(0, L"ActivityLoggerViewer", title.c_str(), WS_OVERLAPPEDWINDOW,
+                        CW_USEDEFAULT, CW_USEDEFAULT, 1200, 700, NULL, NULL, GetModuleHandleW(NULL), this);
+        if (!window) {
+            close();
+            return false;
+        }
+
+        if (indexAll) {
+            size_t firstRow = headerEnd();
+            if (firstRow < size) {
+                std::lock_guard<std::mutex> lock(rowsMutex);
+                rowStarts.push_back(firstRow);
+            }
+            cancelIndexing = false;
+            indexer = std::thread(&LogViewer::indexRows, this, firstRow);
+        }
+        PostMessageW(window, RowsIndexedMessage, 0, 0);
+
+        ShowWindow(window, SW_SHOWNORMAL);
+        SetForegroundWindow(window);
+        return true;
+    }
+
+public:
+    LogViewer() : window(nullptr), list(nullptr), file(INVALID_HANDLE_VALUE), mapping(nullptr), data(nullptr),
+                  size(0), cancelIndexing(false), cachedRow(SIZE_MAX) {}
+
+    ~LogViewer() {
+        if (window) {
+            DestroyWindow(window);
+        }
+        close();
+    }
+
+    LogViewer(const LogViewer&) = delete;
+    LogViewer& operator=(const LogViewer&) = delete;
+
+    HWND getHwnd() const { return window; }
+
+    // Maps csvPath and shows the viewer. Fails for a missing or empty file,
+    // in which case nothing is created. closed runs when the window goes away.
+    bool open(const std::string& csvPath, const std::wstring& title, std::function<void()> closed) {
+        if (isColdLogPath(csvPath)) {
+            if (decodeColdLogToCsv(csvPath, decoded) <= 0) {
+                close();
+                return false;
+            }
+            data = decoded.data();
+            size = decoded.size();
+            return show(title, std::move(closed));
+        }
+        
+        if (!mapFile(csvPath)) return false;
+        return show(title, std::move(closed));
+    }
+
+    // Like open(), but lists only the rows starting at rowOffsets, in order
+    bool openRows(const std::string& csvPath, std::vector<size_t> rowOffsets, const std::wstring& title,
+                  std::function<void()> closed) {
+        if (rowOffsets.empty() || !mapFile(csvPath)) return false;
+        while (!rowOffsets.empty() && rowOffsets.back() >= size) rowOffsets.pop_back();
+        {
+            std::lock_guard<std::mutex> lock(rowsMutex);
+            rowStarts = std::move(rowOffsets);
+        }
+        return show(title, std::move(closed), false);
+    }
+};
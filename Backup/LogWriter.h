@@ -0,0 +1,347 @@
+// LogWriter.h
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ColdStorage.h"
+#include "CsvFormat.h"
+#include "LogPartitions.h"
+#include "LoggerStats.h"
+#include "SegmentLog.h"
+#include "SegmentSink.h"
+#include "Settings.h"
+#include "StringPool.h"
+#include "Utf8.h"
+
+// The log file sink. It keeps its handles open and batches rows: pending
+// records are written once FlushRecords accumulate or FlushIntervalMs after
+// the oldest one arrived, and immediately on a flush or stop. Records are
+// encoded only when written, as UTF-8 CSV or as the binary segment log, into
+// the partition their start time falls in (see LogPartitions.h).
+//
+// With ColdStorage on, each move to another CSV partition (and the first
+// one after startup) compacts the closed partitions on a background thread.
+// The writer owns the index, so the sink thread renames their entries once
+// the thread is done.
+class LogWriter : public ISegmentSink {
+private:
+    static constexpr size_t FlushRecords = 128;
+    static constexpr DWORD FlushIntervalMs = 30 * 1000;
+    static constexpr size_t MaxPendingRecords = 20000;
+    static constexpr size_t MaxPendingBytes = 8 * 1024 * 1024;    // binary, encoded
+    static constexpr DWORD CompactionPollMs = 5 * 1000;
+
+    LogFormat format;
+    const StringPool* strings;
+    HANDLE file;
+    SegmentLogWriter segmentLog;
+    LogPartitions partitions;
+
+    // Path of the partition being written; read by other threads
+    std::string activePath;
+    mutable std::mutex activePathMutex;
+
+    // Sink thread only
+    std::vector<LogRecord> pending;
+    ULONGLONG pendingSince;
+    std::string rows;
+    std::string window, details, process, category;
+    CsvRowFormatter csvRows;
+    WriterStats stats;
+
+    // Compaction; compacted belongs to the compactor until compactorDone
+    bool coldStorage;
+    std::thread compactor;
+    std::atomic<bool> compactorDone;
+    std::vector<std::pair<std::string, uint64_t>> compacted;    // CSV path, cold file bytes
+
+    void setActivePath(const std::string& path) {
+        std::lock_guard<std::mutex> lock(activePathMutex);
+        activePath = path;
+    }
+
+    // Number of leading pending records that belong in the same partition
+    size_t partitionRun(size_t begin, std::string& path) const {
+        path = partitions.pathFor(std::chrono::system_clock::to_time_t(pending[begin].start));
+        size_t end = begin + 1;
+        if (!partitions.isPartitioned()) return pending.size() - begin;
+        while (end < pending.size() &&
+               partitions.pathFor(std::chrono::system_clock::to_time_t(pending[end].start)) == path) {
+            end++;
+        }
+        return end - begin;
+    }
+
+    void recordRun(const std::string& path, size_t begin, size_t count, int64_t fileBytes, int64_t rowsOffset) {
+        partitions.recordWritten(path, std::chrono::system_clock::to_time_t(pending[begin].start),
+                                 std::chrono::system_clock::to_time_t(pending[begin + count - 1].end),
+                                 count, fileBytes < 0 ? 0 : static_cast<uint64_t>(fileBytes),
+                                 rowsOffset < 0 ? 0 : static_cast<uint64_t>(rowsOffset));
+    }
+
+    bool openCsv(const std::string& path) {
+        if (file != INVALID_HANDLE_VALUE) {
+            if (path == activePath) return true;
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+
+        file = CreateFileA(path.c_str(), FILE_APPEND_DATA,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart == 0) {
+            DWORD written;
+            WriteFile(file, CsvHeader, sizeof(CsvHeader) - 1, &written, NULL);
+        }
+        setActivePath(path);
+        startCompaction();
+        return true;
+    }
+
+    // Hands every closed CSV partition to the compactor, unless a previous
+    // round is still running; the next move picks up what that one skips
+    void startCompaction() {
+        if (!coldStorage || !partitions.isPartitioned()) return;
+        finishCompaction(false);
+        if (compactor.joinable()) return;
+
+        std::string current = partitions.pathFor(time(nullptr));
+        std::vector<std::string> closed;
+        for (const auto& partition : partitions.list()) {
+            std::string path = partitions.pathOf(partition.name);
+            if (isColdLogPath(path) || _stricmp(path.c_str(), current.c_str()) == 0 ||
+                _stricmp(path.c_str(), activePath.c_str()) == 0) {
+                continue;
+            }
+            closed.push_back(path);
+        }
+        if (closed.empty()) return;
+
+        compactorDone = false;
+        compactor = std::thread([this, closed = std::move(closed)] {
+            SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+            for (const auto& path : closed) {
+                if (!compactPartition(path)) continue;
+                std::string coldPath = coldPathFor(path);
+                HANDLE cold = CreateFileA(coldPath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                          NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+                int64_t bytes = (cold != INVALID_HANDLE_VALUE) ? segment_log_detail::fileSize(cold) : 0;
+                if (cold != INVALID_HANDLE_VALUE) CloseHandle(cold);
+                compacted.emplace_back(path, bytes < 0 ? 0 : static_cast<uint64_t>(bytes));
+            }
+            compactorDone = true;
+        });
+    }
+
+    // Points the index at the cold files of a finished round; with wait,
+    // blocks for a running one
+    void finishCompaction(bool wait) {
+        if (!compactor.joinable() || (!wait && !compactorDone)) return;
+        compactor.join();
+        for (const auto& entry : compacted) {
+            partitions.recordCompacted(entry.first, coldPathFor(entry.first), entry.second);
+        }
+        compacted.clear();
+        partitions.saveIndex();
+    }
+
+    bool writeCsvRun(const std::string& path, size_t begin, size_t count) {
+        if (!openCsv(path)) return false;
+
+        int64_t formatStart = qpcNow();
+        rows.clear();
+        for (size_t i = begin; i < begin + count; i++) {
+            const LogRecord& record = pending[i];
+            auto duration = std::chrono::duration_cast<std::chrono::seconds>(record.end - record.start).count();
+            assignUtf8(window, record.window);
+            assignUtf8(details, strings->get(record.details));
+            assignUtf8(process, strings->get(record.process));
+            assignUtf8(category, strings->get(record.category));
+            csvRows.appendRow(rows, std::chrono::system_clock::to_time_t(record.start),
+                              std::chrono::system_clock::to_time_t(record.end), duration,
+                              window, details, process, category);
+        }
+        stats.format.record(formatStart);
+
+        int64_t writeStart = qpcNow();
+        DWORD written = 0;
+        bool ok = WriteFile(file, rows.data(), static_cast<DWORD>(rows.size()), &written, NULL) &&
+                  written == rows.size();
+        stats.write.record(writeStart);
+        if (ok) {
+            stats.records.add(count);
+            stats.bytes.add(written);
+            int64_t fileBytes = segment_log_detail::fileSize(file);
+            recordRun(path, begin, count, fileBytes, fileBytes - static_cast<int64_t>(written));
+            return true;
+        }
+        stats.failedWrites.add();
+        // Reopen on the next attempt in case the handle went bad
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    // Writes runs until one fails; the written ones leave pending
+    bool writeCsv() {
+        size_t begin = 0;
+        std::string path;
+        while (begin < pending.size()) {
+            size_t count = partitionRun(begin, path);
+            if (!writeCsvRun(path, begin, count)) {
+                pending.erase(pending.begin(), pending.begin() + begin);
+                return false;
+            }
+            begin += count;
+        }
+        return true;
+    }
+
+    bool writeBinary() {
+        // Bytes left over from a failed write go before anything new, which
+        // waits in pending meanwhile
+        if (segmentLog.pendingBytes() > 0 && !segmentLog.writePending()) {
+            stats.failedWrites.add();
+            return false;
+        }
+
+        size_t begin = 0;
+        std::string path;
+        while (begin < pending.size()) {
+            size_t count = partitionRun(begin, path);
+            std::string base = segmentLogBase(path);
+            if (segmentLog.isOpen() && base != segmentLogBase(activePath)) {
+                // The previous partition's encoded records must land first
+                if (!segmentLog.writePending()) {
+                    pending.erase(pending.begin(), pending.begin() + begin);
+                    return false;
+                }
+                segmentLog.close();
+            }
+            if (!segmentLog.open(base)) {
+                pending.erase(pending.begin(), pending.begin() + begin);
+                return false;
+            }
+            setActivePath(path);
+
+            int64_t rowsOffset = segmentLog.segmentBytes();
+            int64_t formatStart = qpcNow();
+            for (size_t i = begin; i < begin + count; i++) {
+                const LogRecord& record = pending[i];
+                segmentLog.append(std::chrono::system_clock::to_time_t(record.start),
+                                  std::chrono::system_clock::to_time_t(record.end),
+                                  record.window, record.details, record.process, record.category, *strings);
+            }
+            stats.format.record(formatStart);
+
+            int64_t writeStart = qpcNow();
+            size_t encodedBytes = segmentLog.pendingBytes();
+            bool ok = segmentLog.writePending();
+            stats.write.record(writeStart);
+            if (ok) {
+                stats.records.add(count);
+                stats.bytes.add(encodedBytes);
+                recordRun(path, begin, count, segmentLog.fileBytes(), rowsOffset);
+            } else {
+                stats.failedWrites.add();
+            }
+            begin += count;
+        }
+        // Once encoded the records live in the segment log's own buffers,
+        // which it retries on the next flush if this write fails
+        pending.clear();
+        return segmentLog.pendingBytes() == 0;
+    }
+
+    bool hasPending() const {
+        return !pending.empty() || (format == LogFormat::Binary && segmentLog.pendingBytes() > 0);
+    }
+
+    void writePending() {
+        if (!hasPending()) return;
+
+        bool written = (format == LogFormat::Binary) ? writeBinary() : writeCsv();
+        if (partitions.isPartitioned()) {
+            partitions.saveIndex();
+        }
+        if (written) {
+            pending.clear();
+            return;
+        }
+
+        // Keep retrying a full interval later, but never grow without bound
+        pendingSince = GetTickCount64();
+        if (pending.size() > MaxPendingRecords) {
+            pending.clear();
+        }
+        if (segmentLog.pendingBytes() > MaxPendingBytes) {
+            segmentLog.discardPending();
+        }
+    }
+
+public:
+    // The pool must outlive the writer
+    LogWriter(const std::string& path, const Settings& settings, const StringPool& pool)
+        : format(settings.logFormat), strings(&pool), file(INVALID_HANDLE_VALUE), pendingSince(0),
+          coldStorage(settings.coldStorage && settings.logFormat == LogFormat::Csv), compactorDone(true) {
+        partitions.configure(path, settings.partition, settings.partitionBytes);
+        setActivePath(partitions.pathFor(time(nullptr)));
+    }
+
+    ~LogWriter() {
+        close();
+    }
+
+    const char* name() const override { return "Log"; }
+
+    void consume(LogRecord&& record) override {
+        if (pending.empty()) {
+            pendingSince = GetTickCount64();
+        }
+        pending.push_back(std::move(record));
+    }
+
+    DWORD service(bool force) override {
+        // Checks back on a running compaction now and then
+        finishCompaction(false);
+        DWORD wait = compactor.joinable() ? CompactionPollMs : INFINITE;
+        if (!hasPending()) return wait;
+
+        ULONGLONG age = GetTickCount64() - pendingSince;
+        if (force || pending.size() >= FlushRecords || age >= FlushIntervalMs) {
+            writePending();
+            if (!hasPending()) return wait;
+            age = GetTickCount64() - pendingSince;
+        }
+        return std::min(wait, (age >= FlushIntervalMs) ? 0 : static_cast<DWORD>(FlushIntervalMs - age));
+    }
+
+    void close() override {
+        finishCompaction(true);
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+        segmentLog.close();
+    }
+
+    // Sink-thread counters; safe to read from any thread
+    const WriterStats& getStats() const { return stats; }
+
+    // The partition currently being written (the log path itself when the
+    // log is not partitioned)
+    std::string currentLogPath() const {
+        std::lock_guard<std::mutex> lock(activePathMutex);
+        return activePath;
+    }
+};
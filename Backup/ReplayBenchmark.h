@@ -0,0 +1,466 @@
+// ReplayBenchmark.h
+#pragma once
+#include <windows.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AllocationCounter.h"
+#include "CsvReader.h"
+#include "Desktop.h"
+#include "LogReport.h"
+
+// Console entry point of the replay benchmark (nmake bench). Included at the
+// end of ActivityLogger.cpp when built with /DACTIVITYLOGGER_REPLAY, where
+// Desktop.h answers the sampling path's Win32 calls from a trace instead of
+// the desktop. Every sample goes through the real capture, classify, idle
+// and log code of ActivityLogger, back to back with no polling wait.
+//
+//   ActivityLoggerBench.exe [--synthetic N | --csv log.csv] [--out folder] [--sample-ms MS]
+//                           [--formatter legacy]
+//
+// The log, journal, settings and category rules all live in the --out
+// folder, so a copy of ActivitySummary.csv there benchmarks those rules.
+// --formatter legacy then reformats the replay's rows with the formatter the
+// log used before CsvRowFormatter and with CsvRowFormatter, and compares.
+namespace replay_detail {
+
+// One poll: what the desktop showed and when input last happened, in
+// milliseconds from the start of the trace
+struct Sample {
+    int64_t timeMs;
+    int64_t lastInputMs;
+    uint32_t title;
+    uint32_t process;
+};
+
+struct Trace {
+    std::vector<std::wstring> titles;
+    std::vector<std::wstring> imagePaths;
+    std::vector<Sample> samples;
+};
+
+// Idle long enough for any idle threshold, meetings included
+static const int64_t IdleLeadMs = 3600 * 1000LL;
+
+inline std::wstring widen(std::string_view text) {
+    std::wstring wide(text.size(), L'\0');
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                     &wide[0], static_cast<int>(wide.size()));
+    wide.resize(length > 0 ? length : 0);
+    return wide;
+}
+
+inline uint32_t internInto(std::vector<std::wstring>& table, std::unordered_map<std::wstring, uint32_t>& index,
+                           std::wstring text) {
+    auto found = index.find(text);
+    if (found != index.end()) return found->second;
+    uint32_t id = static_cast<uint32_t>(table.size());
+    index.emplace(text, id);
+    table.push_back(std::move(text));
+    return id;
+}
+
+// Fixed-seed LCG so every run replays the same trace
+class Random {
+private:
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint32_t next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    }
+
+    uint32_t below(uint32_t bound) { return next() % bound; }
+};
+
+// A working day's worth of switching, repeated: a few dozen programs with a
+// handful of titles each, dwells of one to two minutes, an occasional title
+// change within a program, and every so often the user walks away
+inline Trace syntheticTrace(size_t count, int64_t sampleMs) {
+    static const wchar_t* const knownPrograms[] = {
+        L"chrome.exe", L"msedge.exe", L"OUTLOOK.EXE", L"Teams.exe", L"Code.exe", L"devenv.exe",
+        L"EXCEL.EXE", L"WINWORD.EXE", L"POWERPNT.EXE", L"explorer.exe", L"cmd.exe", L"notepad.exe"
+    };
+    const uint32_t programCount = 40;
+    const uint32_t titlesPerProgram = 8;
+
+    Trace trace;
+    std::vector<std::wstring> names;
+    for (uint32_t i = 0; i < programCount; i++) {
+        std::wstring name;
+        if (i < sizeof(knownPrograms) / sizeof(knownPrograms[0])) {
+            name = knownPrograms[i];
+        } else {
+            wchar_t generated[32];
+            swprintf(generated, 32, L"Tool%02u.exe", i);
+            name = generated;
+        }
+        trace.imagePaths.push_back(L"C:\\Program Files\\" + name.substr(0, name.size() - 4) + L"\\" + name);
+        for (uint32_t t = 0; t < titlesPerProgram; t++) {
+            wchar_t title[160];
+            swprintf(title, 160, L"Project %u - Document %u.txt - Status report for week %u - %ls",
+                     i * 7 + t, t, (i + t) % 52 + 1, name.c_str());
+            trace.titles.push_back(title);
+        }
+    }
+
+    Random random(20240601);
+    trace.samples.reserve(count);
+    uint32_t process = 0;
+    uint32_t title = 0;
+    size_t dwell = 0;
+    int64_t lastInputMs = 0;
+    size_t idleLeft = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t timeMs = static_cast<int64_t>(i) * sampleMs;
+        if (idleLeft > 0) {
+            idleLeft--;
+        } else if (random.below(2000) == 0) {
+            // Away for 6 to 16 minutes starting now
+            lastInputMs = timeMs;
+            idleLeft = static_cast<size_t>((360000 + random.below(600000)) / sampleMs);
+        } else {
+            lastInputMs = timeMs;
+            if (dwell == 0) {
+                process = random.below(programCount);
+                title = process * titlesPerProgram + random.below(titlesPerProgram);
+                dwell = 30 + random.below(90);
+            } else if (random.below(40) == 0) {
+                title = process * titlesPerProgram + random.below(titlesPerProgram);
+            }
+            dwell--;
+        }
+        trace.samples.push_back({ timeMs, lastInputMs, title, process });
+    }
+    return trace;
+}
+
+// Expands a real log into the polls that produced it: one sample every
+// sampleMs across each row, and an Inactive row as input that stopped long
+// enough before its start to count as idle
+inline bool csvTrace(const std::string& path, int64_t sampleMs, Trace& trace) {
+    CsvReader reader;
+    if (!reader.open(path)) return false;
+
+    std::unordered_map<std::wstring, uint32_t> titleIndex;
+    std::unordered_map<std::wstring, uint32_t> processIndex;
+    CsvReader::Row row;
+    std::string scratch;
+    int64_t origin = 0;
+    bool first = true;
+    uint32_t title = 0;
+    uint32_t process = 0;
+    int64_t timeMs = 0;
+
+    reader.next(row);   // header
+    while (reader.next(row)) {
+        int64_t start, end;
+        if (row.count < 7 || !log_report_detail::parseTimestamp(row.fields[0], start) ||
+            !log_report_detail::parseTimestamp(row.fields[1], end) || end <= start) {
+            continue;
+        }
+        if (first) {
+            origin = start;
+            first = false;
+        }
+        int64_t startMs = (start - origin) * 1000;
+        int64_t endMs = (end - origin) * 1000;
+        if (endMs <= timeMs) continue;
+        if (startMs < timeMs) startMs = timeMs;
+
+        bool inactive = row.text(6, scratch) == "Inactive";
+        if (!inactive) {
+            title = internInto(trace.titles, titleIndex, widen(row.text(3, scratch)));
+            std::wstring name = widen(row.text(5, scratch));
+            process = internInto(trace.imagePaths, processIndex, L"C:\\Program Files\\" + name);
+        } else if (trace.titles.empty()) {
+            continue;
+        }
+
+        for (timeMs = startMs; timeMs < endMs; timeMs += sampleMs) {
+            int64_t lastInputMs = inactive ? startMs - IdleLeadMs : timeMs;
+            trace.samples.push_back({ timeMs, lastInputMs, title, process });
+        }
+    }
+    return !trace.samples.empty();
+}
+
+// The row formatter the log used before CsvRowFormatter, as it was, for
+// --formatter legacy: strftime behind a two-entry cache, and std::string
+// appends with the text fields quoted but not escaped
+class LegacyTimestampFormatter {
+private:
+    struct Slot {
+        time_t time = -1;
+        char text[20];
+    };
+    Slot slots[2];
+    int nextSlot = 0;
+
+public:
+    const char* format(time_t time) {
+        for (const Slot& slot : slots) {
+            if (slot.time == time) return slot.text;
+        }
+        Slot& slot = slots[nextSlot];
+        nextSlot ^= 1;
+
+        struct tm local;
+        if (localtime_s(&local, &time) != 0 || strftime(slot.text, sizeof(slot.text), "%Y-%m-%d %H:%M:%S", &local) == 0) {
+            slot.text[0] = '\0';
+        }
+        slot.time = time;
+        return slot.text;
+    }
+};
+
+inline void appendLegacyCsvRow(std::string& out, LegacyTimestampFormatter& timestamps, time_t start, time_t end,
+                               long long durationSeconds, const std::string& window, const std::string& details,
+                               const std::string& process, const std::string& category) {
+    out += timestamps.format(start);
+    out += ',';
+    out += timestamps.format(end);
+    out += ',';
+    out += std::to_string(durationSeconds);
+    out += ",\"";
+    out += window;
+    out += "\",\"";
+    out += details;
+    out += "\",\"";
+    out += process;
+    out += "\",\"";
+    out += category;
+    out += "\"\n";
+}
+
+struct FormattedRow {
+    time_t start;
+    time_t end;
+    long long duration;
+    std::string fields[4];      // window, details, process, category
+};
+
+inline bool parseLocalTime(std::string_view text, time_t& time) {
+    struct tm local = {};
+    std::string copy(text);
+    if (sscanf(copy.c_str(), "%d-%d-%d %d:%d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+               &local.tm_hour, &local.tm_min, &local.tm_sec) != 6) {
+        return false;
+    }
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    local.tm_isdst = -1;
+    time = mktime(&local);
+    return time != -1;
+}
+
+// Reformats every row of the replay's log with both formatters, batch by
+// batch the way the log writer does, and checks they agree wherever no text
+// field holds a quote (which only the new formatter escapes)
+inline void compareFormatters(const std::string& logPath) {
+    std::vector<FormattedRow> rows;
+    CsvReader reader;
+    if (!reader.open(logPath)) {
+        printf("Formatter:    cannot read %s\n", logPath.c_str());
+        return;
+    }
+    CsvReader::Row row;
+    std::string scratch;
+    reader.next(row);   // header
+    while (reader.next(row)) {
+        FormattedRow parsed;
+        if (row.count < 7 || !parseLocalTime(row.fields[0], parsed.start) || !parseLocalTime(row.fields[1], parsed.end)) {
+            continue;
+        }
+        parsed.duration = strtoll(std::string(row.fields[2]).c_str(), nullptr, 10);
+        for (size_t i = 0; i < 4; i++) {
+            parsed.fields[i] = row.text(3 + i, scratch);
+        }
+        rows.push_back(std::move(parsed));
+    }
+    if (rows.empty()) {
+        printf("Formatter:    no rows to format\n");
+        return;
+    }
+
+    const size_t batchRows = 128;
+    const size_t passes = rows.size() >= 1000000 ? 1 : 1000000 / rows.size() + 1;
+    std::string out;
+    out.reserve(64 * 1024);
+
+    LegacyTimestampFormatter legacyTimestamps;
+    int64_t started = qpcNow();
+    for (size_t pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (i % batchRows == 0) out.clear();
+            const FormattedRow& r = rows[i];
+            appendLegacyCsvRow(out, legacyTimestamps, r.start, r.end, r.duration, r.fields[0], r.fields[1],
+                               r.fields[2], r.fields[3]);
+        }
+    }
+    int64_t legacyTicks = qpcNow() - started;
+
+    CsvRowFormatter formatter;
+    started = qpcNow();
+    for (size_t pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (i % batchRows == 0) out.clear();
+            const FormattedRow& r = rows[i];
+            formatter.appendRow(out, r.start, r.end, r.duration, r.fields[0], r.fields[1], r.fields[2], r.fields[3]);
+        }
+    }
+    int64_t currentTicks = qpcNow() - started;
+
+    size_t compared = 0, identical = 0;
+    std::string legacyRow, currentRow;
+    for (const FormattedRow& r : rows) {
+        bool quoted = false;
+        for (const auto& field : r.fields) quoted = quoted || field.find('"') != std::string::npos;
+        if (quoted) continue;
+        legacyRow.clear();
+        currentRow.clear();
+        appendLegacyCsvRow(legacyRow, legacyTimestamps, r.start, r.end, r.duration, r.fields[0], r.fields[1],
+                           r.fields[2], r.fields[3]);
+        formatter.appendRow(currentRow, r.start, r.end, r.duration, r.fields[0], r.fields[1], r.fields[2], r.fields[3]);
+        compared++;
+        if (legacyRow == currentRow) identical++;
+    }
+
+    double formatted = static_cast<double>(rows.size() * passes);
+    double frequency = static_cast<double>(qpcFrequency());
+    printf("Formatter:    %zu rows x %zu passes\n", rows.size(), passes);
+    printf("  legacy:     %.3f us/row\n", static_cast<double>(legacyTicks) * 1e6 / frequency / formatted);
+    printf("  current:    %.3f us/row\n", static_cast<double>(currentTicks) * 1e6 / frequency / formatted);
+    printf("  identical:  %zu of %zu rows without quotes\n", identical, compared);
+}
+
+// Tick counts are offset so lastInput never goes below zero
+static const int64_t TickBaseMs = IdleLeadMs + 1000;
+
+inline void show(const Trace& trace, const Sample& sample) {
+    desktop::ReplayState& state = desktop::replayState;
+    state.window = reinterpret_cast<HWND>(static_cast<ULONG_PTR>(sample.process + 1));
+    state.processId = sample.process + 100;
+    state.title = trace.titles[sample.title];
+    state.imagePath = trace.imagePaths[sample.process];
+    state.tickCount = static_cast<DWORD>(TickBaseMs + sample.timeMs);
+    state.lastInputTick = static_cast<DWORD>(TickBaseMs + sample.lastInputMs);
+}
+
+inline int usage() {
+    printf("Usage: ActivityLoggerBench [--synthetic N | --csv log.csv] [--out folder] [--sample-ms MS]\n"
+           "                           [--formatter legacy]\n");
+    return 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+    using namespace replay_detail;
+    size_t syntheticCount = 1000000;
+    std::string csvPath;
+    std::string outFolder = ".\\ReplayBench\\";
+    int64_t sampleMs = 1000;
+    bool legacyFormatter = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--synthetic") == 0 && hasValue) {
+            syntheticCount = static_cast<size_t>(strtoull(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--csv") == 0 && hasValue) {
+            csvPath = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            outFolder = argv[++i];
+            if (outFolder.back() != '\\' && outFolder.back() != '/') outFolder += '\\';
+        } else if (strcmp(argv[i], "--sample-ms") == 0 && hasValue) {
+            sampleMs = strtoll(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--formatter") == 0 && hasValue && strcmp(argv[i + 1], "legacy") == 0) {
+            legacyFormatter = true;
+            i++;
+        } else {
+            return usage();
+        }
+    }
+    if (sampleMs <= 0 || (csvPath.empty() && syntheticCount == 0)) return usage();
+
+    Trace trace;
+    if (!csvPath.empty()) {
+        if (!csvTrace(csvPath, sampleMs, trace)) {
+            printf("No usable rows in %s\n", csvPath.c_str());
+            return 1;
+        }
+    } else {
+        trace = syntheticTrace(syntheticCount, sampleMs);
+    }
+
+    CreateDirectoryA(outFolder.c_str(), NULL);
+    std::string logPath = outFolder + "ReplayBench_ActivityLog.csv";
+    DeleteFileA(logPath.c_str());
+
+    const size_t count = trace.samples.size();
+    auto base = std::chrono::steady_clock::now();
+    auto at = [&](int64_t timeMs) { return base + std::chrono::milliseconds(timeMs); };
+    double sampleSeconds;
+    double totalSeconds;
+    uint64_t allocations;
+    {
+        ActivityLogger logger(logPath);
+        show(trace, trace.samples[0]);
+        logger.replayBegin(at(trace.samples[0].timeMs));
+
+        uint64_t allocationsBefore = threadAllocationCount();
+        int64_t started = qpcNow();
+        for (size_t i = 1; i < count; i++) {
+            show(trace, trace.samples[i]);
+            logger.replaySample(at(trace.samples[i].timeMs));
+        }
+        int64_t sampled = qpcNow();
+        logger.replayEnd(at(trace.samples[count - 1].timeMs + sampleMs));
+        int64_t flushed = qpcNow();
+        allocations = threadAllocationCount() - allocationsBefore;
+
+        sampleSeconds = static_cast<double>(sampled - started) / static_cast<double>(qpcFrequency());
+        totalSeconds = static_cast<double>(flushed - started) / static_cast<double>(qpcFrequency());
+
+        const SamplerStats& sampler = logger.getSamplerStats();
+        const WriterStats& writer = logger.getWriterStats();
+        double events = static_cast<double>(count);
+        printf("Trace:        %zu samples, %zu titles, %zu programs, %.1f hours\n", count, trace.titles.size(),
+               trace.imagePaths.size(), static_cast<double>(trace.samples[count - 1].timeMs) / 3600000.0);
+        printf("Sampling:     %.1f ns/event (%.3f s)\n", sampleSeconds * 1e9 / events, sampleSeconds);
+        printf("With flush:   %.1f ns/event (%.3f s)\n", totalSeconds * 1e9 / events, totalSeconds);
+#ifdef ACTIVITYLOGGER_COUNT_ALLOCATIONS
+        printf("Allocations:  %.3f/event (%llu), %llu in unchanged samples\n",
+               static_cast<double>(allocations) / events, static_cast<unsigned long long>(allocations),
+               static_cast<unsigned long long>(logger.getSteadyStateAllocations()));
+#else
+        (void)allocations;
+#endif
+        printf("Segments:     %llu, %llu records written, %llu dropped\n",
+               static_cast<unsigned long long>(sampler.segments.get()),
+               static_cast<unsigned long long>(writer.records.get()), logger.getDroppedRecords());
+        printf("Output:       %llu bytes, %.2f bytes/event\n", static_cast<unsigned long long>(writer.bytes.get()),
+               static_cast<double>(writer.bytes.get()) / events);
+        printf("\n");
+        std::string stages;
+        appendStage(stages, "Capture", sampler.capture);
+        appendStage(stages, "Classify", sampler.classify);
+        appendStage(stages, "Format", writer.format);
+        appendStage(stages, "Write", writer.write);
+        printf("%s", stages.c_str());
+    }
+    if (legacyFormatter) {
+        printf("\n");
+        compareFormatters(logPath);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// SamplingScheduler.h
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include "Settings.h"
+
+// Picks the delay until the next foreground sample. Sampling is fast for a
+// few seconds after input or a focus change, relaxes to the active rate
+// after that, and backs off exponentially while no input arrives. On battery
+// it never samples faster than the battery rate. A locked session is not
+// sampled at all: the WTS lock notification pauses the logger.
+class SamplingScheduler {
+private:
+    SamplingSettings bounds;
+    DWORD interval;
+    DWORD lastInputTick;
+    bool onBattery;
+    ULONGLONG powerCheckedTick;
+
+    static constexpr ULONGLONG PowerCheckMs = 30 * 1000;
+
+    // GetSystemPowerStatus is cheap, but the answer changes rarely
+    bool isOnBattery(ULONGLONG now) {
+        if (powerCheckedTick == 0 || now - powerCheckedTick >= PowerCheckMs) {
+            SYSTEM_POWER_STATUS power;
+            onBattery = GetSystemPowerStatus(&power) && power.ACLineStatus == 0;
+            powerCheckedTick = now;
+        }
+        return onBattery;
+    }
+
+public:
+    SamplingScheduler() : interval(0), lastInputTick(0), onBattery(false), powerCheckedTick(0) {}
+
+    void configure(const SamplingSettings& settings) {
+        bounds = settings;
+        interval = bounds.minIntervalMs;
+    }
+
+    // A focus or title change; keeps sampling at the fast rate for a while
+    void onActivity() {
+        interval = bounds.minIntervalMs;
+        lastInputTick = GetTickCount();
+    }
+
+    // Milliseconds until the next sample
+    DWORD nextDelay() {
+        LASTINPUTINFO lii;
+        lii.cbSize = sizeof(LASTINPUTINFO);
+        DWORD now = GetTickCount();
+        if (GetLastInputInfo(&lii) && static_cast<LONG>(lii.dwTime - lastInputTick) > 0) {
+            lastInputTick = lii.dwTime;
+            interval = bounds.minIntervalMs;
+        }
+
+        DWORD sinceInput = now - lastInputTick;
+        if (sinceInput < bounds.fastWindowMs) {
+            interval = bounds.minIntervalMs;
+        } else if (sinceInput < bounds.backoffAfterMs) {
+            interval = bounds.activeIntervalMs;
+        } else {
+            // Idle: double per sample up to the ceiling
+            interval = std::min(std::max(interval, bounds.activeIntervalMs) * 2, bounds.maxIntervalMs);
+        }
+
+        if (isOnBattery(GetTickCount64())) {
+            return std::max(interval, bounds.batteryIntervalMs);
+        }
+        return interval;
+    }
+};
@@ -0,0 +1,124 @@
+// SegmentClassifier.h
+#pragma once
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CategoryMatcher.h"
+#include "CategoryRules.h"
+#include "ClassificationCache.h"
+#include "StringPool.h"
+#include "Utf8.h"
+
+// Case-insensitive equality, without lowercased copies
+inline bool equalsIgnoreCase(std::wstring_view a, std::wstring_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::towlower(a[i]) != std::towlower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The pipeline's second stage: window details and category for a captured
+// (process, title, site), from the current category rules. Everything but
+// the rules watcher runs on the thread that is currently sampling.
+class SegmentClassifier {
+private:
+    StringPool& pool;
+    
+    // Rules file watcher; publishes recompiled matchers for the sampler
+    CategoryRules rules;
+    const CategoryRules::Set* activeRules;
+    ClassificationCache cache;
+    
+    // Interned IDs of the active matcher's categories
+    std::vector<uint32_t> categoryIds;
+    uint32_t uncategorizedId;
+
+public:
+    explicit SegmentClassifier(StringPool& strings)
+        : pool(strings), activeRules(nullptr), uncategorizedId(strings.intern(L"Uncategorized")) {}
+
+    SegmentClassifier(const SegmentClassifier&) = delete;
+    SegmentClassifier& operator=(const SegmentClassifier&) = delete;
+
+    // Compiles the rules file and starts watching it for edits
+    void start(const std::string& rulesPath) {
+        rules.start(rulesPath);
+        adoptRules();
+    }
+
+    void stop() {
+        rules.stop();
+    }
+
+    // Sampling thread, between samples. Switches to the newest compiled
+    // rules if the file was edited; otherwise one atomic load.
+    void adoptRules() {
+        const CategoryRules::Set* latest = rules.latest();
+        if (latest == activeRules) return;
+        
+        activeRules = latest;
+        const CategoryMatcher& matcher = activeRules->matcher;
+        categoryIds.clear();
+        for (size_t i = 0; i < matcher.categoryCount(); i++) {
+            categoryIds.push_back(pool.intern(fromUtf8(matcher.categoryName(static_cast<int>(i)))));
+        }
+        cache.clear();
+        rules.adopted(activeRules);
+    }
+
+    // Returns a prefix of windowTitle; never copies
+    static std::wstring_view getWindowDetails(std::wstring_view windowTitle, std::wstring_view processName) {
+        size_t pos;
+        
+        // Remove common application suffixes
+        if (equalsIgnoreCase(processName, L"excel.exe") && (pos = windowTitle.find(L" - Excel")) != std::wstring_view::npos) {
+            return windowTitle.substr(0, pos);
+        } else if (equalsIgnoreCase(processName, L"winword.exe") && (pos = windowTitle.find(L" - Word")) != std::wstring_view::npos) {
+            return windowTitle.substr(0, pos);
+        } else if (equalsIgnoreCase(processName, L"chrome.exe") && (pos = windowTitle.find(L" - Google Chrome")) != std::wstring_view::npos) {
+            return windowTitle.substr(0, pos);
+        } else if ((pos = windowTitle.rfind(L" - ")) != std::wstring_view::npos) {
+            return windowTitle.substr(0, pos);
+        }
+        
+        return windowTitle;
+    }
+
+    // Uncategorized until start() has compiled the rules
+    uint32_t getCategory(std::wstring_view windowTitle, std::wstring_view processName, std::wstring_view windowDetails) {
+        if (!activeRules) return uncategorizedId;
+        int category = activeRules->matcher.match(processName, windowTitle, windowDetails);
+        if (category == CategoryMatcher::NoMatch) return uncategorizedId;
+        return categoryIds[category];
+    }
+
+    // Memoized getWindowDetails + getCategory. A browser site, when known,
+    // is the details instead of the title guess. The result stays valid
+    // until the next call.
+    const Classification& classify(uint32_t process, std::wstring_view windowTitle,
+                                   std::wstring_view site = std::wstring_view()) {
+        uint64_t key = ClassificationCache::hashKey(process, windowTitle, site);
+        if (const Classification* cached = cache.find(key, process, windowTitle, site)) {
+            return *cached;
+        }
+        
+        const std::wstring& processName = pool.get(process);
+        std::wstring_view details = site.empty() ? getWindowDetails(windowTitle, processName) : site;
+        Classification result;
+        result.category = getCategory(windowTitle, processName, details);
+        result.details = pool.intern(details);
+        return cache.insert(key, process, windowTitle, site, result);
+    }
+
+    // Category of a segment classified before the rules were loaded
+    uint32_t recategorize(uint32_t process, std::wstring_view windowTitle, uint32_t details) {
+        return getCategory(windowTitle, pool.get(process), pool.get(details));
+    }
+
+    const ClassificationCache& getCache() const { return cache; }
+};
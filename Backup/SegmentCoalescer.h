@@ -0,0 +1,128 @@
+// SegmentCoalescer.h
+#pragma once
+#include <windows.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "Settings.h"
+#include "Timestamp.h"
+
+// Sits between the sampler and logActivity and keeps alt-tab flicker and
+// rotating titles out of the log. It holds back at most one closed segment,
+// so its state is bounded whatever the user does:
+//
+//   - a segment shorter than MinSeconds that closes while another is held
+//     is folded into the held one (the held segment's end moves over it);
+//   - a new segment with the same process, details and category as the held
+//     one, starting within MergeGapSeconds of its end, resumes it: the open
+//     segment takes over the held start and everything in between;
+//   - once the open segment outlives MinSeconds nothing can change the held
+//     one and it is let go. The gap only limits what folds and resumes.
+//
+// A held segment is not in the journal, so a crash loses at most the larger
+// of the two bounds. With MinSeconds=1 and MergeGapSeconds=0 every segment
+// passes straight through. Only the thread that is currently sampling calls
+// in.
+class SegmentCoalescer {
+public:
+    struct Segment {
+        Timestamp start;
+        std::chrono::steady_clock::time_point end;
+        std::wstring window;
+        uint32_t process = 0;
+        uint32_t details = 0;
+        uint32_t category = 0;
+    };
+
+private:
+    std::chrono::steady_clock::duration minDuration;
+    std::chrono::steady_clock::duration mergeGap;
+
+    // The held segment and the one last handed out take turns, so a returned
+    // segment stays valid until the next call and titles reuse their buffers
+    Segment slots[2];
+    Segment* held;
+    std::chrono::steady_clock::time_point heldEnd;  // before any folded flicker
+
+    bool passThrough() const {
+        return mergeGap.count() <= 0 && minDuration <= std::chrono::seconds(1);
+    }
+
+    const Segment* release() {
+        const Segment* out = held;
+        held = nullptr;
+        return out;
+    }
+
+    Segment* spare() {
+        return held == &slots[0] ? &slots[1] : &slots[0];
+    }
+
+public:
+    SegmentCoalescer() : minDuration(std::chrono::seconds(1)), mergeGap(0), held(nullptr) {}
+
+    SegmentCoalescer(const SegmentCoalescer&) = delete;
+    SegmentCoalescer& operator=(const SegmentCoalescer&) = delete;
+
+    void configure(const CoalesceSettings& settings) {
+        minDuration = std::chrono::milliseconds(settings.minSegmentMs);
+        mergeGap = std::chrono::milliseconds(settings.mergeGapMs);
+    }
+
+    bool holding() const { return held != nullptr; }
+
+    // Longest a segment can stay held, for timers that settle() rides on
+    DWORD holdMs() const {
+        auto longest = minDuration > mergeGap ? minDuration : mergeGap;
+        return static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(longest).count());
+    }
+
+    // A segment just closed. Returns a segment to log, valid until the next
+    // call, or nullptr.
+    const Segment* close(const Timestamp& start, const std::chrono::steady_clock::time_point& end,
+                         std::wstring_view window, uint32_t process, uint32_t details, uint32_t category) {
+        if (held && end - start.steady < minDuration && start.steady - heldEnd <= mergeGap) {
+            held->end = end;
+            return nullptr;
+        }
+
+        Segment* next = spare();
+        next->start = start;
+        next->end = end;
+        next->window.assign(window.data(), window.size());
+        next->process = process;
+        next->details = details;
+        next->category = category;
+        if (passThrough()) return next;
+
+        const Segment* out = held ? release() : nullptr;
+        held = next;
+        heldEnd = end;
+        return out;
+    }
+
+    // A new segment opened at start. If it continues the held segment, start
+    // moves back to where that one began and true is returned.
+    bool resume(uint32_t process, uint32_t details, uint32_t category, Timestamp& start) {
+        if (!held || held->process != process || held->details != details || held->category != category ||
+            start.steady - heldEnd > mergeGap) {
+            return false;
+        }
+        start = held->start;
+        held = nullptr;
+        return true;
+    }
+
+    // Per sample or heartbeat while a segment is open since openedAt
+    const Segment* settle(const std::chrono::steady_clock::time_point& now,
+                          const std::chrono::steady_clock::time_point& openedAt) {
+        if (!held || now - openedAt < minDuration) return nullptr;
+        return release();
+    }
+
+    // No segment is open (idle, pause, stop): nothing can merge any more
+    const Segment* flush() {
+        return held ? release() : nullptr;
+    }
+};
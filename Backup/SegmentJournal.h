@@ -0,0 +1,169 @@
+// SegmentJournal.h
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <string_view>
+
+// Write-ahead record of the segment that is still open, in a small
+// memory-mapped file next to the log. The sampling thread updates it with
+// plain stores into the mapping and never makes a system call; the pages
+// reach the disk through the cache manager even if the process is killed.
+// On the next start a segment that was never closed is recovered into the
+// log, ending at the last time it was seen alive.
+//
+// A segment change rewrites the record inside a sequence count that is odd
+// while the write is in progress, so a record torn by a crash is recognised
+// and ignored. The heartbeat is one aligned 64-bit store and needs no such
+// protection.
+class SegmentJournal {
+public:
+    static constexpr size_t TitleCapacity = 1024;
+    static constexpr size_t NameCapacity = 260;
+    static constexpr size_t CategoryCapacity = 256;
+
+    struct Record {
+        char magic[8];
+        uint32_t version;
+        uint32_t sequence;      // odd while a segment is being written
+        uint32_t open;          // nonzero while a segment is in flight
+        uint32_t windowLength;
+        uint32_t processLength;
+        uint32_t detailsLength;
+        uint32_t categoryLength;
+        uint32_t reserved;
+        int64_t startMs;        // wall clock, ms since the Unix epoch
+        int64_t lastSeenMs;
+        wchar_t window[TitleCapacity];
+        wchar_t process[NameCapacity];
+        wchar_t details[TitleCapacity];
+        wchar_t category[CategoryCapacity];
+    };
+
+    // A segment left open by a previous run
+    struct Recovered {
+        int64_t startMs;
+        int64_t endMs;
+        std::wstring window;
+        std::wstring process;
+        std::wstring details;
+        std::wstring category;
+    };
+
+private:
+    static constexpr char Magic[8] = { 'A', 'L', 'J', 'O', 'U', 'R', 'N', 'L' };
+    static constexpr uint32_t Version = 1;
+
+    HANDLE file;
+    HANDLE mapping;
+    Record* record;
+
+    static uint32_t copyText(wchar_t* target, size_t capacity, std::wstring_view text) {
+        size_t length = text.size() < capacity ? text.size() : capacity;
+        wmemcpy(target, text.data(), length);
+        return static_cast<uint32_t>(length);
+    }
+
+    static std::wstring readText(const wchar_t* text, uint32_t length, size_t capacity) {
+        return std::wstring(text, length < capacity ? length : capacity);
+    }
+
+    void publish(uint32_t sequence) {
+        std::atomic_thread_fence(std::memory_order_release);
+        reinterpret_cast<volatile uint32_t&>(record->sequence) = sequence;
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+public:
+    SegmentJournal() : file(INVALID_HANDLE_VALUE), mapping(nullptr), record(nullptr) {}
+
+    ~SegmentJournal() {
+        close();
+    }
+
+    SegmentJournal(const SegmentJournal&) = delete;
+    SegmentJournal& operator=(const SegmentJournal&) = delete;
+
+    bool isOpen() const { return record != nullptr; }
+
+    // Maps the journal, creating it if needed. Any segment a previous run
+    // left open is returned through recovered and removed from the journal.
+    bool open(const std::string& path, Recovered& recovered, bool& hasRecovered) {
+        hasRecovered = false;
+        if (isOpen()) return true;
+
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, sizeof(Record), NULL);
+        if (mapping) {
+            record = static_cast<Record*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(Record)));
+        }
+        if (!record) {
+            close();
+            return false;
+        }
+
+        bool valid = memcmp(record->magic, Magic, sizeof(Magic)) == 0 && record->version == Version;
+        if (valid && record->open && (record->sequence & 1) == 0 && record->lastSeenMs > record->startMs) {
+            recovered.startMs = record->startMs;
+            recovered.endMs = record->lastSeenMs;
+            recovered.window = readText(record->window, record->windowLength, TitleCapacity);
+            recovered.process = readText(record->process, record->processLength, NameCapacity);
+            recovered.details = readText(record->details, record->detailsLength, TitleCapacity);
+            recovered.category = readText(record->category, record->categoryLength, CategoryCapacity);
+            hasRecovered = true;
+        }
+
+        memset(record, 0, sizeof(Record));
+        memcpy(record->magic, Magic, sizeof(Magic));
+        record->version = Version;
+
+        // The recovered segment is about to be logged; make sure it is not
+        // recovered a second time
+        FlushViewOfFile(record, sizeof(Record));
+        return true;
+    }
+
+    void close() {
+        if (record) UnmapViewOfFile(record);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        record = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    // Sampling thread. Records a newly opened segment.
+    void begin(int64_t startMs, std::wstring_view window, std::wstring_view process,
+               std::wstring_view details, std::wstring_view category) {
+        if (!record) return;
+
+        uint32_t sequence = record->sequence;
+        publish(sequence | 1);
+        record->startMs = startMs;
+        record->lastSeenMs = startMs;
+        record->windowLength = copyText(record->window, TitleCapacity, window);
+        record->processLength = copyText(record->process, NameCapacity, process);
+        record->detailsLength = copyText(record->details, TitleCapacity, details);
+        record->categoryLength = copyText(record->category, CategoryCapacity, category);
+        record->open = 1;
+        publish((sequence | 1) + 1);
+    }
+
+    // Sampling thread. The open segment was still current at nowMs.
+    void touch(int64_t nowMs) {
+        if (!record) return;
+        reinterpret_cast<volatile int64_t&>(record->lastSeenMs) = nowMs;
+    }
+
+    // Sampling thread. The open segment has been handed to the log.
+    void clear() {
+        if (!record) return;
+        reinterpret_cast<volatile uint32_t&>(record->open) = 0;
+    }
+};
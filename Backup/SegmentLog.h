@@ -0,0 +1,411 @@
+// SegmentLog.h
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CsvFormat.h"
+#include "StringPool.h"
+#include "Utf8.h"
+
+// Compact binary alternative to the CSV log. A log is a pair of append-only
+// files next to each other:
+//
+//   <base>.seg  SegmentLogHeader, then fixed-width SegmentRecords
+//   <base>.str  SegmentLogHeader, then (uint32 length, UTF-8 bytes) string
+//               entries; a string's ID is its position in the file
+//
+// Strings are always written before the first record that refers to them,
+// so a crash can at worst leave an unreferenced string or a torn record at
+// the tail, both of which are cut off the next time the log is opened.
+
+struct SegmentLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct SegmentRecord {
+    int64_t start;        // seconds since the Unix epoch
+    int64_t end;
+    uint32_t window;      // string IDs
+    uint32_t details;
+    uint32_t process;
+    uint32_t category;
+};
+
+static_assert(sizeof(SegmentLogHeader) == 16, "SegmentLogHeader layout");
+static_assert(sizeof(SegmentRecord) == 32, "SegmentRecord layout");
+
+static const char SegmentFileMagic[8] = { 'A', 'L', 'S', 'E', 'G', 'M', 'N', 'T' };
+static const char StringFileMagic[8] = { 'A', 'L', 'S', 'T', 'R', 'T', 'A', 'B' };
+static const uint32_t SegmentLogVersion = 1;
+
+// "<dir>\\PC_ActivityLog.csv" -> "<dir>\\PC_ActivityLog"
+inline std::string segmentLogBase(const std::string& logPath) {
+    size_t dot = logPath.find_last_of('.');
+    size_t slash = logPath.find_last_of("\\/");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return logPath;
+    return logPath.substr(0, dot);
+}
+
+namespace segment_log_detail {
+
+inline bool writeAll(HANDLE file, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        DWORD chunk = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        DWORD written = 0;
+        if (!WriteFile(file, bytes, chunk, &written, NULL) || written == 0) return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+inline bool readAll(HANDLE file, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        DWORD chunk = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        DWORD read = 0;
+        if (!ReadFile(file, bytes, chunk, &read, NULL) || read == 0) return false;
+        bytes += read;
+        size -= read;
+    }
+    return true;
+}
+
+inline int64_t fileSize(HANDLE file) {
+    LARGE_INTEGER size;
+    return GetFileSizeEx(file, &size) ? size.QuadPart : -1;
+}
+
+inline bool seekTo(HANDLE file, int64_t offset, DWORD method = FILE_BEGIN) {
+    LARGE_INTEGER distance;
+    distance.QuadPart = offset;
+    return SetFilePointerEx(file, distance, NULL, method) != 0;
+}
+
+// Appends buffer at fileEnd. What reached the file leaves the buffer and
+// moves fileEnd; after a failure the file is cut back to fileEnd, so a retry
+// continues from there instead of writing the same bytes twice.
+inline bool appendPending(HANDLE file, std::string& buffer, int64_t& fileEnd) {
+    size_t done = 0;
+    bool ok = true;
+    while (done < buffer.size()) {
+        size_t left = buffer.size() - done;
+        DWORD chunk = left > 0x40000000 ? 0x40000000 : static_cast<DWORD>(left);
+        DWORD written = 0;
+        if (!WriteFile(file, buffer.data() + done, chunk, &written, NULL) || written == 0) {
+            ok = false;
+            break;
+        }
+        done += written;
+    }
+    fileEnd += static_cast<int64_t>(done);
+    buffer.erase(0, done);
+    if (!ok && seekTo(file, fileEnd)) {
+        SetEndOfFile(file);
+    }
+    return ok;
+}
+
+// Reads the whole string table; returns the byte offset just past the last
+// complete entry, or -1 if the file is not a string table
+inline int64_t readStringTable(HANDLE file, std::vector<std::string>& strings) {
+    int64_t size = fileSize(file);
+    SegmentLogHeader header;
+    if (size < static_cast<int64_t>(sizeof(header)) || !seekTo(file, 0) || !readAll(file, &header, sizeof(header)) ||
+        memcmp(header.magic, StringFileMagic, sizeof(header.magic)) != 0) {
+        return -1;
+    }
+
+    std::vector<char> contents(static_cast<size_t>(size - sizeof(header)));
+    if (!contents.empty() && !readAll(file, contents.data(), contents.size())) return -1;
+
+    size_t pos = 0;
+    while (pos + sizeof(uint32_t) <= contents.size()) {
+        uint32_t length;
+        memcpy(&length, contents.data() + pos, sizeof(length));
+        if (pos + sizeof(length) + length > contents.size()) break;
+        strings.emplace_back(contents.data() + pos + sizeof(length), length);
+        pos += sizeof(length) + length;
+    }
+    return static_cast<int64_t>(sizeof(header) + pos);
+}
+
+inline HANDLE openLogFile(const std::string& path, const char (&magic)[8], uint32_t recordSize) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return file;
+
+    if (fileSize(file) == 0) {
+        SegmentLogHeader header;
+        memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = SegmentLogVersion;
+        header.recordSize = recordSize;
+        if (!writeAll(file, &header, sizeof(header))) {
+            CloseHandle(file);
+            return INVALID_HANDLE_VALUE;
+        }
+    }
+    return file;
+}
+
+} // namespace segment_log_detail
+
+// Writer side of the binary log. Not thread-safe; owned by the log writer.
+class SegmentLogWriter {
+private:
+    std::string basePath;
+    HANDLE segmentFile;
+    HANDLE stringFile;
+
+    std::unordered_map<std::string, uint32_t> ids;
+    uint32_t stringCount;
+
+    // File IDs persist across runs while pool IDs only last a process, so
+    // pooled strings are translated through a direct table
+    std::vector<uint32_t> poolToFile;
+    static constexpr uint32_t Unmapped = 0xFFFFFFFF;
+
+    std::string pendingStrings;
+    std::string pendingSegments;
+    std::string scratch;
+
+    // Where the written part of each file ends
+    int64_t stringsEnd;
+    int64_t segmentsEnd;
+
+    uint32_t intern(const std::string& text) {
+        auto it = ids.find(text);
+        if (it != ids.end()) return it->second;
+
+        uint32_t length = static_cast<uint32_t>(text.size());
+        pendingStrings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        pendingStrings += text;
+
+        uint32_t id = stringCount++;
+        ids.emplace(text, id);
+        return id;
+    }
+
+    uint32_t internPooled(uint32_t poolId, const StringPool& pool) {
+        if (poolId >= poolToFile.size()) {
+            poolToFile.resize(poolId + 1, Unmapped);
+        }
+        uint32_t& fileId = poolToFile[poolId];
+        if (fileId == Unmapped) {
+            // Each pooled string is converted once, when first written
+            fileId = intern(toUtf8(pool.get(poolId)));
+        }
+        return fileId;
+    }
+
+public:
+    SegmentLogWriter() : segmentFile(INVALID_HANDLE_VALUE), stringFile(INVALID_HANDLE_VALUE), stringCount(0),
+                         stringsEnd(0), segmentsEnd(0) {}
+
+    ~SegmentLogWriter() {
+        close();
+    }
+
+    bool isOpen() const { return segmentFile != INVALID_HANDLE_VALUE; }
+
+    // Opens or creates <base>.seg/.str, loads the existing string table and
+    // cuts off anything a crash left half-written
+    bool open(const std::string& base) {
+        using namespace segment_log_detail;
+        if (isOpen()) return true;
+
+        basePath = base;
+        stringFile = openLogFile(base + ".str", StringFileMagic, 0);
+        if (stringFile == INVALID_HANDLE_VALUE) return false;
+        segmentFile = openLogFile(base + ".seg", SegmentFileMagic, sizeof(SegmentRecord));
+        if (segmentFile == INVALID_HANDLE_VALUE) {
+            close();
+            return false;
+        }
+
+        std::vector<std::string> strings;
+        stringsEnd = readStringTable(stringFile, strings);
+        int64_t segmentsSize = fileSize(segmentFile);
+        if (stringsEnd < 0 || segmentsSize < static_cast<int64_t>(sizeof(SegmentLogHeader))) {
+            close();
+            return false;
+        }
+
+        const int64_t headerSize = sizeof(SegmentLogHeader);
+        const int64_t recordSize = sizeof(SegmentRecord);
+        segmentsEnd = segmentsSize - (segmentsSize - headerSize) % recordSize;
+        if (!seekTo(stringFile, stringsEnd) || !SetEndOfFile(stringFile) ||
+            !seekTo(segmentFile, segmentsEnd) || !SetEndOfFile(segmentFile)) {
+            close();
+            return false;
+        }
+
+        ids.clear();
+        poolToFile.clear();
+        stringCount = 0;
+        for (auto& text : strings) {
+            ids.emplace(std::move(text), stringCount++);
+        }
+        return true;
+    }
+
+    void close() {
+        if (stringFile != INVALID_HANDLE_VALUE) CloseHandle(stringFile);
+        if (segmentFile != INVALID_HANDLE_VALUE) CloseHandle(segmentFile);
+        stringFile = segmentFile = INVALID_HANDLE_VALUE;
+    }
+
+    // Encodes a segment into the pending buffers; requires isOpen()
+    void append(int64_t start, int64_t end, std::wstring_view window,
+                uint32_t details, uint32_t process, uint32_t category, const StringPool& pool) {
+        SegmentRecord record;
+        record.start = start;
+        record.end = end;
+        scratch.clear();
+        appendUtf8(scratch, window);
+        record.window = intern(scratch);
+        record.details = internPooled(details, pool);
+        record.process = internPooled(process, pool);
+        record.category = internPooled(category, pool);
+        pendingSegments.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+
+    size_t pendingBytes() const { return pendingStrings.size() + pendingSegments.size(); }
+
+    // Where the next record goes in the .seg file
+    int64_t segmentBytes() const { return segmentsEnd + static_cast<int64_t>(pendingSegments.size()); }
+
+    // Bytes on disk across both files
+    int64_t fileBytes() const {
+        using namespace segment_log_detail;
+        if (!isOpen()) return 0;
+        return fileSize(segmentFile) + fileSize(stringFile);
+    }
+
+    // Strings go first so every record on disk can be resolved. A failed
+    // write keeps the unwritten remainder for the next call.
+    bool writePending() {
+        using namespace segment_log_detail;
+        if (!pendingStrings.empty() && !appendPending(stringFile, pendingStrings, stringsEnd)) return false;
+        if (!pendingSegments.empty() && !appendPending(segmentFile, pendingSegments, segmentsEnd)) return false;
+        return true;
+    }
+
+    // Drops everything not yet written. The string IDs handed out for the
+    // dropped strings are forgotten by reloading the table from disk.
+    bool discardPending() {
+        pendingStrings.clear();
+        pendingSegments.clear();
+        std::string base = basePath;
+        close();
+        return open(base);
+    }
+};
+
+// Sequential reader over a binary log
+class SegmentLogReader {
+private:
+    HANDLE segmentFile;
+    std::vector<std::string> strings;
+    std::vector<SegmentRecord> buffer;
+    size_t bufferPos;
+    size_t bufferCount;
+    static const std::string emptyString;
+
+public:
+    SegmentLogReader() : segmentFile(INVALID_HANDLE_VALUE), bufferPos(0), bufferCount(0) {}
+
+    ~SegmentLogReader() {
+        if (segmentFile != INVALID_HANDLE_VALUE) CloseHandle(segmentFile);
+    }
+
+    bool open(const std::string& base) {
+        using namespace segment_log_detail;
+        HANDLE stringFile = CreateFileA((base + ".str").c_str(), GENERIC_READ,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (stringFile == INVALID_HANDLE_VALUE) return false;
+        int64_t stringsEnd = readStringTable(stringFile, strings);
+        CloseHandle(stringFile);
+        if (stringsEnd < 0) return false;
+
+        segmentFile = CreateFileA((base + ".seg").c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (segmentFile == INVALID_HANDLE_VALUE) return false;
+
+        SegmentLogHeader header;
+        if (!readAll(segmentFile, &header, sizeof(header)) ||
+            memcmp(header.magic, SegmentFileMagic, sizeof(header.magic)) != 0 ||
+            header.recordSize != sizeof(SegmentRecord)) {
+            CloseHandle(segmentFile);
+            segmentFile = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        buffer.resize(2048);
+        return true;
+    }
+
+    // Returns false at the end of the log; a torn trailing record is skipped
+    bool next(SegmentRecord& record) {
+        if (bufferPos == bufferCount) {
+            DWORD read = 0;
+            if (!ReadFile(segmentFile, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(SegmentRecord)),
+                          &read, NULL)) {
+                return false;
+            }
+            bufferPos = 0;
+            bufferCount = read / sizeof(SegmentRecord);
+            if (bufferCount == 0) return false;
+        }
+        record = buffer[bufferPos++];
+        return true;
+    }
+
+    const std::string& text(uint32_t id) const {
+        return id < strings.size() ? strings[id] : emptyString;
+    }
+};
+
+inline const std::string SegmentLogReader::emptyString;
+
+// Streams a binary log out as CSV in the regular log layout. Returns the
+// number of rows written, or -1 if either file could not be opened.
+inline long long exportSegmentLogToCsv(const std::string& base, const std::string& csvPath) {
+    using namespace segment_log_detail;
+    SegmentLogReader reader;
+    if (!reader.open(base)) return -1;
+
+    HANDLE out = CreateFileA(csvPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out == INVALID_HANDLE_VALUE) return -1;
+
+    std::string chunk(CsvHeader);
+    CsvRowFormatter csvRows;
+    long long rows = 0;
+    SegmentRecord record;
+    bool ok = true;
+    while (ok && reader.next(record)) {
+        csvRows.appendRow(chunk, static_cast<time_t>(record.start), static_cast<time_t>(record.end),
+                          record.end - record.start,
+                          reader.text(record.window), reader.text(record.details),
+                          reader.text(record.process), reader.text(record.category));
+        rows++;
+        if (chunk.size() >= 256 * 1024) {
+            ok = writeAll(out, chunk.data(), chunk.size());
+            chunk.clear();
+        }
+    }
+    if (ok && !chunk.empty()) {
+        ok = writeAll(out, chunk.data(), chunk.size());
+    }
+    CloseHandle(out);
+    return ok ? rows : -1;
+}
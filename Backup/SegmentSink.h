@@ -0,0 +1,204 @@
+// SegmentSink.h
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "SpscRing.h"
+
+// One finished segment on its way to the sinks. Everything but the window
+// title is a StringPool ID; text stays UTF-16 until a sink encodes it.
+struct LogRecord {
+    std::chrono::system_clock::time_point start;
+    std::chrono::system_clock::time_point end;
+    std::wstring window;
+    uint32_t process;
+    uint32_t details;
+    uint32_t category;
+    uint32_t user = 0;      // session host only: whose session it came from
+};
+
+// Where finished segments go: the log file, the day totals, a server. Each
+// sink runs on its own thread behind its own queue (see SegmentPipeline), so
+// every call below is made from that thread only.
+class ISegmentSink {
+public:
+    virtual ~ISegmentSink() {}
+
+    // Short label for diagnostics
+    virtual const char* name() const = 0;
+
+    // A sink that never reads LogRecord::window gets records without it,
+    // which saves a string copy per segment
+    virtual bool wantsWindow() const { return true; }
+
+    // Takes one record off the queue, in submission order
+    virtual void consume(LogRecord&& record) = 0;
+
+    // Called after every wake-up, once the queue is drained. force asks the
+    // sink to write out everything it holds (flush or stop). Returns how long
+    // until it next needs calling, INFINITE if only new records matter.
+    virtual DWORD service(bool force) = 0;
+
+    // After the last record, before the thread exits
+    virtual void close() {}
+};
+
+// Fans finished segments out to the sinks. The sampling thread pushes each
+// record into every sink's bounded lock-free queue and never waits for one:
+// a sink that falls QueueCapacity records behind loses records (counted per
+// sink) rather than holding back sampling or the other sinks.
+class SegmentPipeline {
+public:
+    static constexpr size_t QueueCapacity = 4096;
+
+private:
+    static constexpr DWORD FlushWaitMs = 5000;
+
+    struct Stage {
+        std::unique_ptr<ISegmentSink> sink;
+        SpscRing<LogRecord, QueueCapacity> queue;
+        std::thread thread;
+        HANDLE wakeEvent = nullptr;
+        HANDLE flushedEvent = nullptr;
+        std::atomic<bool> stopping{ false };
+        std::atomic<bool> flushRequested{ false };
+        std::atomic<unsigned long long> dropped{ 0 };
+
+        void run() {
+            DWORD timeout = INFINITE;
+            for (;;) {
+                WaitForSingleObject(wakeEvent, timeout);
+
+                // The flags are read before the drain, so everything submitted
+                // before flush() or stop() asked is consumed before answering
+                bool stopNow = stopping.load();
+                bool flushNow = flushRequested.exchange(false);
+                LogRecord record;
+                while (queue.tryPop(record)) {
+                    sink->consume(std::move(record));
+                }
+                timeout = sink->service(stopNow || flushNow);
+                if (flushNow) {
+                    SetEvent(flushedEvent);
+                }
+                if (stopNow && queue.empty()) break;
+            }
+            sink->close();
+        }
+
+        bool push(LogRecord&& record) {
+            if (!queue.tryPush(std::move(record))) {
+                dropped++;
+                return false;
+            }
+            SetEvent(wakeEvent);
+            return true;
+        }
+    };
+
+    std::vector<std::unique_ptr<Stage>> stages;
+    size_t windowOwner;     // stage that is handed the record itself
+    bool running;
+
+public:
+    SegmentPipeline() : windowOwner(0), running(false) {}
+
+    ~SegmentPipeline() {
+        stop();
+    }
+
+    SegmentPipeline(const SegmentPipeline&) = delete;
+    SegmentPipeline& operator=(const SegmentPipeline&) = delete;
+
+    // Before start(). Returns the sink, which the pipeline owns.
+    template <typename Sink>
+    Sink* add(std::unique_ptr<Sink> sink) {
+        Sink* added = sink.get();
+        std::unique_ptr<Stage> stage(new Stage());
+        stage->sink = std::move(sink);
+        stages.push_back(std::move(stage));
+        return added;
+    }
+
+    void start() {
+        if (running) return;
+        windowOwner = stages.empty() ? 0 : stages.size() - 1;
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (stages[i]->sink->wantsWindow()) windowOwner = i;
+        }
+        for (auto& stage : stages) {
+            stage->stopping = false;
+            stage->wakeEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+            stage->flushedEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+            stage->thread = std::thread(&Stage::run, stage.get());
+        }
+        running = true;
+    }
+
+    // Drains every queue into its sink and closes it
+    void stop() {
+        if (!running) return;
+        for (auto& stage : stages) {
+            stage->stopping = true;
+            SetEvent(stage->wakeEvent);
+        }
+        for (auto& stage : stages) {
+            stage->thread.join();
+            CloseHandle(stage->wakeEvent);
+            CloseHandle(stage->flushedEvent);
+            stage->wakeEvent = stage->flushedEvent = nullptr;
+        }
+        running = false;
+    }
+
+    // Producer side; at most one thread at a time. One sink is handed the
+    // record itself, the others a copy (without the title if they have no
+    // use for it).
+    void submit(LogRecord&& record) {
+        if (!running || stages.empty()) return;
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (i == windowOwner) continue;
+            if (stages[i]->sink->wantsWindow()) {
+                stages[i]->push(LogRecord(record));
+            } else {
+                stages[i]->push(LogRecord{ record.start, record.end, std::wstring(), record.process,
+                                           record.details, record.category, record.user });
+            }
+        }
+        stages[windowOwner]->push(std::move(record));
+    }
+
+    // Blocks until every sink has written what was submitted so far, or
+    // FlushWaitMs have passed
+    void flush() {
+        if (!running) return;
+        for (auto& stage : stages) {
+            ResetEvent(stage->flushedEvent);
+            stage->flushRequested = true;
+            SetEvent(stage->wakeEvent);
+        }
+        ULONGLONG deadline = GetTickCount64() + FlushWaitMs;
+        for (auto& stage : stages) {
+            ULONGLONG now = GetTickCount64();
+            WaitForSingleObject(stage->flushedEvent, now < deadline ? static_cast<DWORD>(deadline - now) : 0);
+        }
+    }
+
+    size_t sinkCount() const { return stages.size(); }
+    const ISegmentSink& sink(size_t index) const { return *stages[index]->sink; }
+
+    // Records lost because a sink's queue was full; safe from any thread
+    unsigned long long droppedRecords(size_t index) const { return stages[index]->dropped.load(); }
+
+    unsigned long long droppedRecords() const {
+        unsigned long long total = 0;
+        for (const auto& stage : stages) total += stage->dropped.load();
+        return total;
+    }
+};
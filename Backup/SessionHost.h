@@ -0,0 +1,434 @@
+// SessionHost.h
+#pragma once
+#include <windows.h>
+#include <wtsapi32.h>
+#include <shlobj.h>
+#include <sddl.h>
+#include <userenv.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HostLink.h"
+#include "LogWriter.h"
+#include "SegmentSink.h"
+#include "Settings.h"
+#include "StringPool.h"
+#include "Utf8.h"
+
+#pragma comment(lib, "advapi32.lib")
+#pragma comment(lib, "userenv.lib")
+#pragma comment(lib, "wtsapi32.lib")
+
+// The host's only sink: one log per user, all written from this one sink
+// thread. Logs are <folder>\<COMPUTER>_<user>_ActivityLog.csv, so the
+// report tool lists every user of a host as its own machine.
+class SessionLogSink : public ISegmentSink {
+private:
+    struct UserLog {
+        uint32_t user;
+        std::unique_ptr<LogWriter> writer;
+    };
+
+    std::string folder;
+    std::string machine;
+    Settings settings;
+    const StringPool* strings;
+    std::vector<UserLog> logs;      // a handful of users; scanned linearly
+
+    // User names may carry characters a file name cannot
+    static std::string fileNamePart(const std::wstring& user) {
+        std::string name = toUtf8(user);
+        for (char& c : name) {
+            bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                         c == '.' || c == '-';
+            if (!plain) c = '_';
+        }
+        return name.empty() ? "Unknown" : name;
+    }
+
+    LogWriter& writerFor(uint32_t user) {
+        for (auto& log : logs) {
+            if (log.user == user) return *log.writer;
+        }
+        std::string path = folder + machine + "_" + fileNamePart(strings->get(user)) + "_ActivityLog.csv";
+        logs.push_back(UserLog{ user, std::make_unique<LogWriter>(path, settings, *strings) });
+        return *logs.back().writer;
+    }
+
+public:
+    // The pool must outlive the sink
+    SessionLogSink(const std::string& logFolder, const Settings& hostSettings, const StringPool& pool)
+        : folder(logFolder), settings(hostSettings), strings(&pool) {
+        char computerName[MAX_COMPUTERNAME_LENGTH + 1];
+        DWORD size = MAX_COMPUTERNAME_LENGTH + 1;
+        machine = GetComputerNameA(computerName, &size) ? computerName : "Host";
+    }
+
+    const char* name() const override { return "Sessions"; }
+
+    void consume(LogRecord&& record) override {
+        writerFor(record.user).consume(std::move(record));
+    }
+
+    DWORD service(bool force) override {
+        DWORD wait = INFINITE;
+        for (auto& log : logs) {
+            DWORD next = log.writer->service(force);
+            if (next < wait) wait = next;
+        }
+        return wait;
+    }
+
+    void close() override {
+        for (auto& log : logs) {
+            log.writer->close();
+        }
+    }
+
+    size_t userCount() const { return logs.size(); }
+};
+
+// Service mode for Remote Desktop hosts. GetForegroundWindow only sees the
+// caller's own session, so each interactive session still runs a small
+// agent (ActivityLogger.exe --agent): event-driven capture and
+// classification, no log files, no timers beyond the idle check. Everything
+// else -- the pipe server, the one writer thread and every user's log --
+// lives in this single host process, so adding a user adds a sleeping agent
+// and a pipe instance rather than another poller and file writer.
+//
+// All pipe instances are served by one thread with overlapped I/O; the
+// per-session state is a flat array, one slot per instance, so the wait is
+// one WaitForMultipleObjects over their events.
+class SessionHost {
+public:
+    static constexpr size_t MaxSessions = MAXIMUM_WAIT_OBJECTS - 1;     // plus the stop event
+
+private:
+    struct Session {
+        HANDLE pipe = INVALID_HANDLE_VALUE;
+        OVERLAPPED overlapped = {};
+        bool pending = false;       // overlapped holds an issued connect or read
+        bool connected = false;
+        DWORD sessionId = 0;
+        uint32_t user = StringPool::Empty;
+        std::vector<char> buffer;
+    };
+
+    std::string folder;
+    Settings settings;
+    StringPool strings;
+    SegmentPipeline pipeline;
+    SessionLogSink* logs;
+    std::vector<Session> sessions;
+    PSECURITY_DESCRIPTOR security;
+
+    // Pipe thread only
+    std::wstring window, process, details, category;
+    StatCounter records;
+    StatCounter rejectedMessages;
+
+    // Agents run as the signed-in user; only interactive users may write.
+    // The first instance fails if anyone else already serves the name.
+    bool createPipe(Session& session, bool first) {
+        SECURITY_ATTRIBUTES attributes = { sizeof(attributes), security, FALSE };
+        DWORD openMode = PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0);
+        session.pipe = CreateNamedPipeW(host_link::PipeName, openMode,
+                                        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT |
+                                        PIPE_REJECT_REMOTE_CLIENTS,
+                                        static_cast<DWORD>(MaxSessions), 0,
+                                        static_cast<DWORD>(host_link::MessageCapacity), 0,
+                                        security ? &attributes : NULL);
+        return session.pipe != INVALID_HANDLE_VALUE;
+    }
+
+    // Waits for the next agent on this instance. An instance that cannot
+    // listen at all stays idle; the others keep serving. An agent that
+    // connected before the call leaves no I/O pending, so the event is set
+    // by hand and onSignaled must not ask for an overlapped result.
+    void listen(Session& session) {
+        session.connected = false;
+        session.pending = false;
+        session.user = StringPool::Empty;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            ResetEvent(session.overlapped.hEvent);
+            if (ConnectNamedPipe(session.pipe, &session.overlapped)) {
+                SetEvent(session.overlapped.hEvent);
+                return;
+            }
+            DWORD error = GetLastError();
+            if (error == ERROR_IO_PENDING) {
+                session.pending = true;
+                return;
+            }
+            if (error == ERROR_PIPE_CONNECTED) {
+                SetEvent(session.overlapped.hEvent);
+                return;
+            }
+            // ERROR_NO_DATA: a client came and went before we listened
+            DisconnectNamedPipe(session.pipe);
+        }
+    }
+
+    // Completes with an overlapped result whether or not it finishes at once
+    void read(Session& session) {
+        if (ReadFile(session.pipe, session.buffer.data(), static_cast<DWORD>(session.buffer.size()), NULL,
+                     &session.overlapped) || GetLastError() == ERROR_IO_PENDING) {
+            session.pending = true;
+            return;
+        }
+        DisconnectNamedPipe(session.pipe);
+        listen(session);
+    }
+
+    void identify(Session& session) {
+        session.sessionId = 0;
+        GetNamedPipeClientSessionId(session.pipe, &session.sessionId);
+        LPWSTR name = nullptr;
+        DWORD bytes = 0;
+        std::wstring user;
+        if (WTSQuerySessionInformationW(WTS_CURRENT_SERVER_HANDLE, session.sessionId, WTSUserName, &name, &bytes) &&
+            name) {
+            user = name;
+            WTSFreeMemory(name);
+        }
+        if (user.empty()) {
+            user = L"Session" + std::to_wstring(session.sessionId);
+        }
+        session.user = strings.intern(user);
+    }
+
+    void deliver(const Session& session, DWORD bytes) {
+        host_link::MessageReader reader(session.buffer.data(), bytes);
+        uint32_t magic, count;
+        if (!reader.uint32(magic) || magic != host_link::Magic || !reader.uint32(count)) {
+            rejectedMessages.add();
+            return;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t startMs, endMs;
+            if (!reader.int64(startMs) || !reader.int64(endMs) || !reader.text(window) || !reader.text(process) ||
+                !reader.text(details) || !reader.text(category) || endMs < startMs) {
+                rejectedMessages.add();
+                return;
+            }
+            LogRecord record{ std::chrono::system_clock::time_point(std::chrono::milliseconds(startMs)),
+                              std::chrono::system_clock::time_point(std::chrono::milliseconds(endMs)),
+                              window, strings.intern(process), strings.intern(details), strings.intern(category) };
+            record.user = session.user;
+            pipeline.submit(std::move(record));
+            records.add();
+        }
+    }
+
+    void onSignaled(Session& session) {
+        DWORD bytes = 0;
+        BOOL ok = TRUE;
+        if (session.pending) {
+            ok = GetOverlappedResult(session.pipe, &session.overlapped, &bytes, FALSE);
+            session.pending = false;
+        }
+        if (ok && !session.connected) {
+            session.connected = true;
+            session.buffer.resize(host_link::MessageCapacity);
+            identify(session);
+            read(session);
+        } else if (ok) {
+            deliver(session, bytes);
+            read(session);
+        } else {
+            // The agent went away, or sent more than one message can hold
+            DisconnectNamedPipe(session.pipe);
+            listen(session);
+        }
+    }
+
+    // The kernel writes into overlapped and buffer until a cancelled
+    // operation completes, so wait for that before anything is freed
+    void cancelPending() {
+        for (auto& session : sessions) {
+            if (!session.pending) continue;
+            CancelIoEx(session.pipe, &session.overlapped);
+            DWORD bytes = 0;
+            GetOverlappedResult(session.pipe, &session.overlapped, &bytes, TRUE);
+            session.pending = false;
+        }
+    }
+
+public:
+    explicit SessionHost(const std::string& logFolder) : folder(logFolder), logs(nullptr), security(nullptr) {
+        CreateDirectoryA(folder.c_str(), NULL);
+        settings = Settings::load(folder + "ActivityLogger.ini");
+        logs = pipeline.add(std::make_unique<SessionLogSink>(folder, settings, strings));
+        ConvertStringSecurityDescriptorToSecurityDescriptorW(L"D:(A;;GA;;;SY)(A;;GA;;;BA)(A;;GRGW;;;IU)",
+                                                             SDDL_REVISION_1, &security, NULL);
+    }
+
+    ~SessionHost() {
+        for (auto& session : sessions) {
+            if (session.pipe != INVALID_HANDLE_VALUE) CloseHandle(session.pipe);
+            if (session.overlapped.hEvent) CloseHandle(session.overlapped.hEvent);
+        }
+        pipeline.stop();
+        if (security) LocalFree(security);
+    }
+
+    SessionHost(const SessionHost&) = delete;
+    SessionHost& operator=(const SessionHost&) = delete;
+
+    // Serves agents until stopEvent is set; false if no pipe could be made
+    bool run(HANDLE stopEvent) {
+        sessions.resize(MaxSessions);
+        for (size_t i = 0; i < sessions.size(); i++) {
+            Session& session = sessions[i];
+            session.overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+            if (!createPipe(session, i == 0)) {
+                cancelPending();
+                return false;
+            }
+            listen(session);
+        }
+        pipeline.start();
+
+        std::vector<HANDLE> waits;
+        waits.push_back(stopEvent);
+        for (auto& session : sessions) {
+            waits.push_back(session.overlapped.hEvent);
+        }
+        for (;;) {
+            DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(waits.size()), waits.data(), FALSE, INFINITE);
+            if (signaled == WAIT_OBJECT_0 || signaled >= WAIT_OBJECT_0 + waits.size()) break;
+            onSignaled(sessions[signaled - WAIT_OBJECT_0 - 1]);
+        }
+
+        cancelPending();
+        pipeline.stop();
+        return true;
+    }
+
+    uint64_t recordsReceived() const { return records.get(); }
+    uint64_t messagesRejected() const { return rejectedMessages.get(); }
+};
+
+namespace session_host_detail {
+
+// Starts "<this exe> --agent" on the session's desktop, as its user. Needs
+// LocalSystem (WTSQueryUserToken); a session without a user is skipped.
+inline void launchAgent(DWORD sessionId) {
+    HANDLE token = nullptr;
+    if (!WTSQueryUserToken(sessionId, &token)) return;
+
+    wchar_t exe[MAX_PATH];
+    DWORD length = GetModuleFileNameW(NULL, exe, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) {
+        CloseHandle(token);
+        return;
+    }
+    std::wstring commandLine = std::wstring(L"\"") + exe + L"\" --agent";
+
+    void* environment = nullptr;
+    CreateEnvironmentBlock(&environment, token, FALSE);
+    STARTUPINFOW startup = {};
+    startup.cb = sizeof(startup);
+    startup.lpDesktop = const_cast<LPWSTR>(L"winsta0\\default");
+    PROCESS_INFORMATION process = {};
+    if (CreateProcessAsUserW(token, exe, &commandLine[0], NULL, NULL, FALSE,
+                             CREATE_UNICODE_ENVIRONMENT | CREATE_NO_WINDOW, environment, NULL, &startup, &process)) {
+        CloseHandle(process.hThread);
+        CloseHandle(process.hProcess);
+    }
+    if (environment) DestroyEnvironmentBlock(environment);
+    CloseHandle(token);
+}
+
+// One agent for every session someone is signed in to
+inline void launchAgents() {
+    PWTS_SESSION_INFOW list = nullptr;
+    DWORD count = 0;
+    if (!WTSEnumerateSessionsW(WTS_CURRENT_SERVER_HANDLE, 0, 1, &list, &count)) return;
+    for (DWORD i = 0; i < count; i++) {
+        if (list[i].State == WTSActive || list[i].State == WTSDisconnected) {
+            launchAgent(list[i].SessionId);
+        }
+    }
+    WTSFreeMemory(list);
+}
+
+struct ServiceState {
+    SERVICE_STATUS_HANDLE handle = nullptr;
+    SERVICE_STATUS status = {};
+    HANDLE stopEvent = nullptr;
+    std::string folder;
+};
+
+inline ServiceState service;
+
+inline void reportStatus(DWORD state, DWORD exitCode = NO_ERROR) {
+    service.status.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+    service.status.dwCurrentState = state;
+    service.status.dwWin32ExitCode = exitCode;
+    service.status.dwControlsAccepted = (state == SERVICE_RUNNING)
+        ? SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN | SERVICE_ACCEPT_SESSIONCHANGE : 0;
+    SetServiceStatus(service.handle, &service.status);
+}
+
+inline DWORD WINAPI serviceControl(DWORD control, DWORD eventType, LPVOID eventData, LPVOID) {
+    switch (control) {
+        case SERVICE_CONTROL_STOP:
+        case SERVICE_CONTROL_SHUTDOWN:
+            reportStatus(SERVICE_STOP_PENDING);
+            SetEvent(service.stopEvent);
+            return NO_ERROR;
+        case SERVICE_CONTROL_SESSIONCHANGE:
+            // Agents end with their session, so only sign-ins matter
+            if (eventType == WTS_SESSION_LOGON && eventData) {
+                launchAgent(static_cast<WTSSESSION_NOTIFICATION*>(eventData)->dwSessionId);
+            }
+            return NO_ERROR;
+        case SERVICE_CONTROL_INTERROGATE:
+            return NO_ERROR;
+    }
+    return ERROR_CALL_NOT_IMPLEMENTED;
+}
+
+inline void WINAPI serviceMain(DWORD, LPWSTR*) {
+    service.handle = RegisterServiceCtrlHandlerExW(L"ActivityLoggerHost", serviceControl, NULL);
+    if (!service.handle) return;
+    service.stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    DWORD exitCode = NO_ERROR;
+    {
+        SessionHost host(service.folder);
+        reportStatus(SERVICE_RUNNING);
+        launchAgents();
+        if (!host.run(service.stopEvent)) exitCode = ERROR_PIPE_BUSY;
+    }
+    reportStatus(SERVICE_STOPPED, exitCode);
+    CloseHandle(service.stopEvent);
+}
+
+}
+
+// %ProgramData%\ActivityLogger\, with a trailing separator
+inline std::string sessionHostFolder() {
+    char path[MAX_PATH];
+    if (SHGetFolderPathA(NULL, CSIDL_COMMON_APPDATA, NULL, 0, path) == S_OK) {
+        return std::string(path) + "\\ActivityLogger\\";
+    }
+    return ".\\";
+}
+
+// Entry point of --service, under the service control manager:
+//
+//   sc create ActivityLoggerHost binPath= "C:\...\ActivityLogger.exe --service" start= auto
+//
+// Returns false when not started by the SCM.
+inline bool runSessionHostService(const std::string& folder) {
+    session_host_detail::service.folder = folder;
+    SERVICE_TABLE_ENTRYW table[] = {
+        { const_cast<LPWSTR>(L"ActivityLoggerHost"), session_host_detail::serviceMain },
+        { NULL, NULL }
+    };
+    return StartServiceCtrlDispatcherW(table) != FALSE;
+}
@@ -0,0 +1,128 @@
+// Settings.h
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+enum class LogFormat { Csv, Binary };
+enum class PartitionMode { None, Monthly, Size };
+
+// Bounds for the adaptive sampling interval, in milliseconds
+struct SamplingSettings {
+    DWORD minIntervalMs = 250;       // right after input or a focus change
+    DWORD activeIntervalMs = 1000;   // user present but not interacting
+    DWORD maxIntervalMs = 10000;     // ceiling of the idle back-off
+    DWORD batteryIntervalMs = 2000;  // floor on battery or while locked
+    DWORD fastWindowMs = 5000;       // how long the fast rate lasts
+    DWORD backoffAfterMs = 60000;    // no input for this long starts the back-off
+};
+
+// Optional upload of finished segments to a central collector (see
+// UploadSink.h); off while url is empty
+struct UploadSettings {
+    std::wstring url;                           // http:// or https://
+    DWORD intervalMs = 3 * 60 * 1000;           // one batch per interval
+    uint64_t spoolBytes = 16ULL * 1024 * 1024;  // kept on disk while offline
+};
+
+// Merging of short and repeated segments (see SegmentCoalescer.h)
+struct CoalesceSettings {
+    DWORD minSegmentMs = 3000;      // shorter ones fold into their neighbour
+    DWORD mergeGapMs = 10000;       // same activity again within this resumes
+};
+
+// User settings from ActivityLogger.ini, kept next to the log file. Every key
+// is optional and falls back to the built-in default.
+//
+//   [Logging]
+//   Format=csv        ; csv (default) or binary
+//   Partition=none    ; none (default), monthly or size (see LogPartitions.h)
+//   PartitionSizeMB=64
+//   ColdStorage=0     ; 1 = compress closed partitions (see ColdStorage.h)
+//
+//   [Sampling]
+//   MinIntervalMs=250
+//   ActiveIntervalMs=1000
+//   MaxIntervalMs=10000
+//   BatteryIntervalMs=2000
+//   FastWindowMs=5000
+//   BackoffAfterMs=60000
+//
+//   [Segments]
+//   MinSeconds=3      ; 1 with MergeGapSeconds=0 logs every change as before
+//   MergeGapSeconds=10
+//
+//   [Upload]
+//   Url=https://collector.example.com/segments   ; empty (default) = off
+//   IntervalSeconds=180
+//   SpoolMB=16
+//
+//   [Details]
+//   BrowserSites=0    ; 1 = site from the browser's address bar (see BrowserSites.h)
+struct Settings {
+    LogFormat logFormat = LogFormat::Csv;
+    PartitionMode partition = PartitionMode::None;
+    uint64_t partitionBytes = 64ULL * 1024 * 1024;
+    bool coldStorage = false;
+    SamplingSettings sampling;
+    CoalesceSettings segments;
+    UploadSettings upload;
+    bool browserSites = false;
+
+    static Settings load(const std::string& iniPath) {
+        Settings settings;
+        char value[64];
+
+        GetPrivateProfileStringA("Logging", "Format", "csv", value, sizeof(value), iniPath.c_str());
+        if (_stricmp(value, "binary") == 0) {
+            settings.logFormat = LogFormat::Binary;
+        }
+
+        GetPrivateProfileStringA("Logging", "Partition", "none", value, sizeof(value), iniPath.c_str());
+        if (_stricmp(value, "monthly") == 0) {
+            settings.partition = PartitionMode::Monthly;
+        } else if (_stricmp(value, "size") == 0) {
+            settings.partition = PartitionMode::Size;
+        }
+        UINT partitionMB = GetPrivateProfileIntA("Logging", "PartitionSizeMB", 64, iniPath.c_str());
+        settings.partitionBytes = static_cast<uint64_t>(partitionMB > 0 ? partitionMB : 1) * 1024 * 1024;
+        settings.coldStorage = GetPrivateProfileIntA("Logging", "ColdStorage", 0, iniPath.c_str()) != 0;
+
+        SamplingSettings& sampling = settings.sampling;
+        const char* ini = iniPath.c_str();
+        sampling.minIntervalMs = GetPrivateProfileIntA("Sampling", "MinIntervalMs", sampling.minIntervalMs, ini);
+        sampling.activeIntervalMs = GetPrivateProfileIntA("Sampling", "ActiveIntervalMs", sampling.activeIntervalMs, ini);
+        sampling.maxIntervalMs = GetPrivateProfileIntA("Sampling", "MaxIntervalMs", sampling.maxIntervalMs, ini);
+        sampling.batteryIntervalMs = GetPrivateProfileIntA("Sampling", "BatteryIntervalMs", sampling.batteryIntervalMs, ini);
+        sampling.fastWindowMs = GetPrivateProfileIntA("Sampling", "FastWindowMs", sampling.fastWindowMs, ini);
+        sampling.backoffAfterMs = GetPrivateProfileIntA("Sampling", "BackoffAfterMs", sampling.backoffAfterMs, ini);
+
+        // Keep the bounds ordered whatever the file says
+        sampling.minIntervalMs = std::max<DWORD>(sampling.minIntervalMs, 50);
+        sampling.activeIntervalMs = std::max(sampling.activeIntervalMs, sampling.minIntervalMs);
+        sampling.maxIntervalMs = std::max(sampling.maxIntervalMs, sampling.activeIntervalMs);
+        sampling.batteryIntervalMs = std::min(sampling.batteryIntervalMs, sampling.maxIntervalMs);
+        sampling.backoffAfterMs = std::max(sampling.backoffAfterMs, sampling.fastWindowMs);
+
+        UINT minSeconds = GetPrivateProfileIntA("Segments", "MinSeconds", 3, ini);
+        settings.segments.minSegmentMs = std::max<UINT>(minSeconds, 1) * 1000;
+        settings.segments.mergeGapMs = GetPrivateProfileIntA("Segments", "MergeGapSeconds", 10, ini) * 1000;
+
+        char url[1024];
+        GetPrivateProfileStringA("Upload", "Url", "", url, sizeof(url), ini);
+        int length = MultiByteToWideChar(CP_ACP, 0, url, -1, NULL, 0);
+        if (length > 1) {
+            settings.upload.url.resize(length);
+            MultiByteToWideChar(CP_ACP, 0, url, -1, &settings.upload.url[0], length);
+            settings.upload.url.resize(length - 1);
+        }
+        UINT intervalSeconds = GetPrivateProfileIntA("Upload", "IntervalSeconds", 180, ini);
+        settings.upload.intervalMs = std::max<UINT>(intervalSeconds, 10) * 1000;
+        UINT spoolMB = GetPrivateProfileIntA("Upload", "SpoolMB", 16, ini);
+        settings.upload.spoolBytes = static_cast<uint64_t>(spoolMB > 0 ? spoolMB : 1) * 1024 * 1024;
+
+        settings.browserSites = GetPrivateProfileIntA("Details", "BrowserSites", 0, ini) != 0;
+        return settings;
+    }
+};
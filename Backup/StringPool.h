@@ -0,0 +1,80 @@
+// StringPool.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interned UTF-16 strings with stable 32-bit IDs for the lifetime of the
+// process. Process names, window details and categories are interned once,
+// and from then on the sampling path moves and compares IDs instead of
+// strings.
+//
+// One thread interns (the sampling thread); any thread may resolve an ID it
+// was handed, e.g. through the log writer's ring. Storage is chunked so a
+// string never moves once interned and readers need no lock.
+class StringPool {
+public:
+    static constexpr uint32_t Empty = 0;
+
+private:
+    static constexpr uint32_t ChunkBits = 10;
+    static constexpr uint32_t ChunkSize = 1u << ChunkBits;
+    static constexpr uint32_t MaxChunks = 4096;
+
+    std::atomic<std::wstring*> chunks[MaxChunks];
+    std::atomic<uint32_t> count;
+
+    // Interning thread only; keys view the pooled strings themselves
+    std::unordered_map<std::wstring_view, uint32_t> index;
+
+    std::wstring& slot(uint32_t id) const {
+        return chunks[id >> ChunkBits].load(std::memory_order_acquire)[id & (ChunkSize - 1)];
+    }
+
+public:
+    StringPool() : count(0) {
+        for (auto& chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+        intern(std::wstring_view());
+    }
+
+    ~StringPool() {
+        for (auto& chunk : chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    // Interning thread only. Allocates only the first time a string is seen.
+    uint32_t intern(std::wstring_view text) {
+        auto it = index.find(text);
+        if (it != index.end()) return it->second;
+
+        uint32_t id = count.load(std::memory_order_relaxed);
+        if ((id >> ChunkBits) >= MaxChunks) return Empty; // pool exhausted; degrade to ""
+
+        std::atomic<std::wstring*>& chunk = chunks[id >> ChunkBits];
+        if (!chunk.load(std::memory_order_relaxed)) {
+            chunk.store(new std::wstring[ChunkSize], std::memory_order_release);
+        }
+        std::wstring& stored = slot(id);
+        stored.assign(text.data(), text.size());
+
+        index.emplace(std::wstring_view(stored), id);
+        count.store(id + 1, std::memory_order_release);
+        return id;
+    }
+
+    // Any thread, for IDs obtained from intern()
+    const std::wstring& get(uint32_t id) const {
+        return slot(id < count.load(std::memory_order_acquire) ? id : Empty);
+    }
+
+    uint32_t size() const { return count.load(std::memory_order_acquire); }
+};
@@ -0,0 +1,31 @@
+// Timestamp.h
+#pragma once
+#include <chrono>
+
+// A reading of the monotonic clock paired with the wall-clock time at the
+// same instant. Segments are timed on steady_clock, so an NTP step or a DST
+// change can never make one negative or inflate it; the wall clock is read
+// once, when the segment starts, and every later wall time is derived from
+// that anchor.
+struct Timestamp {
+    std::chrono::steady_clock::time_point steady;
+    std::chrono::system_clock::time_point wall;
+
+    static Timestamp now() {
+        return at(std::chrono::steady_clock::now());
+    }
+
+    // Anchors an earlier (or current) steady reading, e.g. a back-dated event
+    static Timestamp at(std::chrono::steady_clock::time_point when) {
+        Timestamp stamp;
+        stamp.steady = when;
+        stamp.wall = std::chrono::system_clock::now() -
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::steady_clock::now() - when);
+        return stamp;
+    }
+
+    // Wall time of a later steady reading, measured from this anchor
+    std::chrono::system_clock::time_point wallAt(std::chrono::steady_clock::time_point later) const {
+        return wall + std::chrono::duration_cast<std::chrono::system_clock::duration>(later - steady);
+    }
+};
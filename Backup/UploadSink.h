@@ -0,0 +1,392 @@
+// UploadSink.h
+#pragma once
+#include <windows.h>
+#include <winhttp.h>
+#include <compressapi.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include "CsvFormat.h"
+#include "LoggerStats.h"
+#include "SegmentSink.h"
+#include "Settings.h"
+#include "StringPool.h"
+#include "Utf8.h"
+
+#pragma comment(lib, "winhttp.lib")
+#pragma comment(lib, "cabinet.lib")
+
+// Sends finished segments to a central collector instead of relying on a
+// synced copy of the whole log. Records are collected into one batch per
+// interval: rows in the log's CSV layout, XPRESS-compressed with the Windows
+// Compression API and POSTed over HTTP/2 where the server offers it:
+//
+//   POST /segments
+//   Content-Type: text/csv; charset=utf-8
+//   Content-Encoding: xpress-huff        (Compression API buffer format)
+//   X-Machine: PC
+//   X-Batch: 01da8c3f5a2b7e00            (same on every retry of a batch)
+//
+// Each batch is written to the spool folder before it is sent and deleted
+// once the collector answers 2xx, so batches survive offline periods and
+// restarts. The spool is bounded; when it is full the oldest batch that is
+// not in flight is dropped. WinHTTP runs asynchronously: the sink thread
+// starts a request and polls for its outcome between records.
+class UploadSink : public ISegmentSink {
+public:
+    struct Stats {
+        StatCounter batches;        // accepted by the collector
+        StatCounter sentBytes;      // compressed
+        StatCounter rawBytes;       // before compression
+        StatCounter failures;
+        StatCounter droppedBatches; // pushed out of a full spool
+        std::atomic<uint64_t> spooled{ 0 };     // waiting now
+    };
+
+private:
+    static constexpr size_t MaxBatchRecords = 5000;
+    static constexpr DWORD InFlightPollMs = 250;
+    static constexpr DWORD CloseWaitMs = 2000;
+    static constexpr DWORD MaxRetryMs = 30 * 60 * 1000;
+
+    enum Outcome { Pending, Succeeded, Failed };
+
+    struct SpoolEntry {
+        std::string name;
+        uint64_t bytes;
+    };
+
+    UploadSettings settings;
+    const StringPool* strings;
+    std::string spoolFolder;
+    std::wstring machineHeader;
+
+    // WinHTTP handles; the session carries the status callback
+    HINTERNET session;
+    HINTERNET connection;
+    std::wstring requestPath;
+    bool secure;
+    COMPRESSOR_HANDLE compressor;
+
+    // Batch being collected
+    std::string rows;
+    size_t batchRecords;
+    ULONGLONG batchSince;
+    std::string window, details, process, category;
+    CsvRowFormatter csvRows;
+
+    // Spooled batches, oldest first; the front one is sent first
+    std::deque<SpoolEntry> spool;
+    uint64_t spoolBytes;
+    uint64_t lastSequence;
+
+    // Request in flight, if any. Its body must stay put until WinHTTP is
+    // done with the handle.
+    HINTERNET request;
+    std::vector<char> body;
+    std::atomic<int> outcome;
+    HANDLE requestClosed;
+    ULONGLONG retryAt;
+    DWORD retryDelayMs;
+
+    Stats stats;
+
+    static void CALLBACK statusCallback(HINTERNET handle, DWORD_PTR context, DWORD status, LPVOID info, DWORD) {
+        UploadSink* sink = reinterpret_cast<UploadSink*>(context);
+        if (!sink) return;
+        switch (status) {
+        case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            if (!WinHttpReceiveResponse(handle, NULL)) sink->outcome = Failed;
+            break;
+        case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE: {
+            DWORD code = 0, size = sizeof(code);
+            WinHttpQueryHeaders(handle, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                                WINHTTP_HEADER_NAME_BY_INDEX, &code, &size, WINHTTP_NO_HEADER_INDEX);
+            sink->outcome = (code >= 200 && code < 300) ? Succeeded : Failed;
+            break;
+        }
+        case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+            sink->outcome = Failed;
+            break;
+        case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+            SetEvent(sink->requestClosed);
+            break;
+        }
+        (void)info;
+    }
+
+    bool connect() {
+        URL_COMPONENTS parts = {};
+        parts.dwStructSize = sizeof(parts);
+        wchar_t host[256];
+        wchar_t path[1024];
+        parts.lpszHostName = host;
+        parts.dwHostNameLength = ARRAYSIZE(host);
+        parts.lpszUrlPath = path;
+        parts.dwUrlPathLength = ARRAYSIZE(path);
+        if (!WinHttpCrackUrl(settings.url.c_str(), 0, 0, &parts)) return false;
+        secure = parts.nScheme == INTERNET_SCHEME_HTTPS;
+        requestPath.assign(path, parts.dwUrlPathLength);
+        if (requestPath.empty()) requestPath = L"/";
+
+        session = WinHttpOpen(L"ActivityLogger", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME,
+                              WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+        if (!session) return false;
+#ifdef WINHTTP_OPTION_ENABLE_HTTP_PROTOCOL
+        // Falls back to HTTP/1.1 on systems or servers without HTTP/2
+        DWORD protocols = WINHTTP_PROTOCOL_FLAG_HTTP2;
+        WinHttpSetOption(session, WINHTTP_OPTION_ENABLE_HTTP_PROTOCOL, &protocols, sizeof(protocols));
+#endif
+        WinHttpSetStatusCallback(session, statusCallback,
+                                 WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES, 0);
+        connection = WinHttpConnect(session, host, parts.nPort, 0);
+        return connection != nullptr;
+    }
+
+    void loadSpool() {
+        CreateDirectoryA(spoolFolder.c_str(), NULL);
+        std::vector<SpoolEntry> found;
+        WIN32_FIND_DATAA data;
+        HANDLE search = FindFirstFileA((spoolFolder + "*.batch").c_str(), &data);
+        if (search != INVALID_HANDLE_VALUE) {
+            do {
+                uint64_t size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+                found.push_back({ data.cFileName, size });
+            } while (FindNextFileA(search, &data));
+            FindClose(search);
+        }
+        // Names are fixed-width hex sequence numbers, so they sort by age
+        std::sort(found.begin(), found.end(), [](const SpoolEntry& a, const SpoolEntry& b) { return a.name < b.name; });
+        for (auto& entry : found) {
+            spoolBytes += entry.bytes;
+            lastSequence = std::max<uint64_t>(lastSequence, strtoull(entry.name.c_str(), nullptr, 16));
+            spool.push_back(std::move(entry));
+        }
+        stats.spooled = spool.size();
+    }
+
+    // Sequence numbers follow the clock so they keep increasing across runs
+    std::string nextBatchName() {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        uint64_t sequence = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+        if (sequence <= lastSequence) sequence = lastSequence + 1;
+        lastSequence = sequence;
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.batch", static_cast<unsigned long long>(sequence));
+        return name;
+    }
+
+    bool writeFile(const std::string& path, const void* data, size_t size) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        DWORD written = 0;
+        bool ok = WriteFile(file, data, static_cast<DWORD>(size), &written, NULL) && written == size;
+        CloseHandle(file);
+        if (!ok) DeleteFileA(path.c_str());
+        return ok;
+    }
+
+    bool readFile(const std::string& path, std::vector<char>& data) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        bool ok = GetFileSizeEx(file, &size) && size.QuadPart < 0x7fffffff;
+        if (ok) {
+            data.resize(static_cast<size_t>(size.QuadPart));
+            DWORD read = 0;
+            ok = data.empty() || (ReadFile(file, data.data(), static_cast<DWORD>(data.size()), &read, NULL) &&
+                                  read == data.size());
+        }
+        CloseHandle(file);
+        return ok;
+    }
+
+    void removeSpooled(size_t index) {
+        DeleteFileA((spoolFolder + spool[index].name).c_str());
+        spoolBytes -= spool[index].bytes;
+        spool.erase(spool.begin() + index);
+        stats.spooled = spool.size();
+    }
+
+    // Compresses the collected rows into a new spool file
+    void sealBatch() {
+        std::vector<char> compressed;
+        SIZE_T needed = 0;
+        Compress(compressor, rows.data(), rows.size(), NULL, 0, &needed);
+        compressed.resize(needed);
+        SIZE_T size = 0;
+        bool ok = needed > 0 && Compress(compressor, rows.data(), rows.size(), compressed.data(), needed, &size);
+
+        std::string name = nextBatchName();
+        if (ok && writeFile(spoolFolder + name, compressed.data(), size)) {
+            spool.push_back({ name, size });
+            spoolBytes += size;
+            stats.spooled = spool.size();
+            stats.rawBytes.add(rows.size());
+        } else {
+            stats.failures.add();
+        }
+        rows.clear();
+        batchRecords = 0;
+
+        // Drop the oldest batches that are not being sent right now
+        size_t oldest = request ? 1 : 0;
+        while (spoolBytes > settings.spoolBytes && spool.size() > oldest + 1) {
+            removeSpooled(oldest);
+            stats.droppedBatches.add();
+        }
+    }
+
+    void startUpload() {
+        const SpoolEntry& entry = spool.front();
+        if (!readFile(spoolFolder + entry.name, body)) {
+            removeSpooled(0);
+            return;
+        }
+
+        request = WinHttpOpenRequest(connection, L"POST", requestPath.c_str(), NULL, WINHTTP_NO_REFERER,
+                                     WINHTTP_DEFAULT_ACCEPT_TYPES, secure ? WINHTTP_FLAG_SECURE : 0);
+        if (!request) {
+            uploadFailed();
+            return;
+        }
+        // Set before sending so even a failed send reports the handle closing
+        DWORD_PTR context = reinterpret_cast<DWORD_PTR>(this);
+        WinHttpSetOption(request, WINHTTP_OPTION_CONTEXT_VALUE, &context, sizeof(context));
+        std::wstring headers = L"Content-Type: text/csv; charset=utf-8\r\nContent-Encoding: xpress-huff\r\n" +
+                               machineHeader + L"X-Batch: " +
+                               std::wstring(entry.name.begin(), entry.name.end() - 6) + L"\r\n";
+        outcome = Pending;
+        ResetEvent(requestClosed);
+        if (!WinHttpSendRequest(request, headers.c_str(), static_cast<DWORD>(headers.size()), body.data(),
+                                static_cast<DWORD>(body.size()), static_cast<DWORD>(body.size()),
+                                reinterpret_cast<DWORD_PTR>(this))) {
+            closeRequest();
+            uploadFailed();
+        }
+    }
+
+    // Sink thread; waits for the callback's last word on the handle
+    void closeRequest() {
+        if (!request) return;
+        WinHttpCloseHandle(request);
+        request = nullptr;
+        WaitForSingleObject(requestClosed, CloseWaitMs);
+    }
+
+    void uploadFailed() {
+        stats.failures.add();
+        retryAt = GetTickCount64() + retryDelayMs;
+        retryDelayMs = std::min<DWORD>(retryDelayMs * 2, MaxRetryMs);
+    }
+
+    void finishUpload() {
+        bool ok = outcome == Succeeded;
+        closeRequest();
+        if (ok) {
+            stats.batches.add();
+            stats.sentBytes.add(body.size());
+            removeSpooled(0);
+            retryDelayMs = settings.intervalMs;
+            retryAt = 0;
+        } else {
+            uploadFailed();
+        }
+        body.clear();
+    }
+
+public:
+    // Batches wait in spoolFolder (created if missing); the pool must outlive
+    // the sink
+    UploadSink(const UploadSettings& uploadSettings, const std::string& folder, const StringPool& pool)
+        : settings(uploadSettings), strings(&pool), spoolFolder(folder), session(nullptr), connection(nullptr),
+          secure(false), compressor(nullptr), batchRecords(0), batchSince(0), spoolBytes(0), lastSequence(0),
+          request(nullptr), outcome(Pending), retryAt(0), retryDelayMs(uploadSettings.intervalMs) {
+        char computerName[MAX_COMPUTERNAME_LENGTH + 1];
+        DWORD size = MAX_COMPUTERNAME_LENGTH + 1;
+        computerName[0] = '\0';
+        GetComputerNameA(computerName, &size);
+        machineHeader = L"X-Machine: " + std::wstring(computerName, computerName + strlen(computerName)) + L"\r\n";
+
+        requestClosed = CreateEventA(NULL, TRUE, TRUE, NULL);
+        if (!CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, NULL, &compressor)) {
+            compressor = nullptr;
+        }
+        loadSpool();
+        connect();
+    }
+
+    ~UploadSink() {
+        close();
+        if (compressor) CloseCompressor(compressor);
+        CloseHandle(requestClosed);
+    }
+
+    // False if the URL or the system's WinHTTP/compression support is unusable
+    bool isUsable() const { return connection != nullptr && compressor != nullptr; }
+
+    const char* name() const override { return "Upload"; }
+
+    void consume(LogRecord&& record) override {
+        if (!compressor) return;
+        if (rows.empty()) {
+            rows.assign(CsvHeader, sizeof(CsvHeader) - 1);
+            batchSince = GetTickCount64();
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::seconds>(record.end - record.start).count();
+        assignUtf8(window, record.window);
+        assignUtf8(details, strings->get(record.details));
+        assignUtf8(process, strings->get(record.process));
+        assignUtf8(category, strings->get(record.category));
+        csvRows.appendRow(rows, std::chrono::system_clock::to_time_t(record.start),
+                          std::chrono::system_clock::to_time_t(record.end), duration,
+                          window, details, process, category);
+        batchRecords++;
+    }
+
+    DWORD service(bool force) override {
+        ULONGLONG now = GetTickCount64();
+        if (request && outcome != Pending) {
+            finishUpload();
+        }
+        if (batchRecords > 0 &&
+            (force || batchRecords >= MaxBatchRecords || now - batchSince >= settings.intervalMs)) {
+            sealBatch();
+        }
+        if (!request && !spool.empty() && connection && now >= retryAt) {
+            startUpload();
+        }
+
+        if (request) return InFlightPollMs;
+        ULONGLONG wait = INFINITE;
+        if (batchRecords > 0) {
+            ULONGLONG age = now - batchSince;
+            wait = (age >= settings.intervalMs) ? 0 : settings.intervalMs - age;
+        }
+        if (!spool.empty() && connection) {
+            ULONGLONG untilRetry = (retryAt > now) ? retryAt - now : 0;
+            if (untilRetry < wait) wait = untilRetry;
+        }
+        return static_cast<DWORD>(wait);
+    }
+
+    // An upload still in flight is abandoned; its batch stays in the spool
+    void close() override {
+        closeRequest();
+        if (connection) WinHttpCloseHandle(connection);
+        if (session) WinHttpCloseHandle(session);
+        connection = session = nullptr;
+    }
+
+    // Sink-thread counters; safe to read from any thread
+    const Stats& getStats() const { return stats; }
+};
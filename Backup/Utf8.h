@@ -0,0 +1,39 @@
+// Utf8.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <string_view>
+
+// Window text is captured and compared as UTF-16; these convert at the edges
+// (rule files on the way in, log files on the way out).
+
+// Appends the UTF-8 encoding of text to out, reusing out's capacity
+inline void appendUtf8(std::string& out, std::wstring_view text) {
+    if (text.empty()) return;
+    int length = WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), NULL, 0, NULL, NULL);
+    if (length <= 0) return;
+    size_t offset = out.size();
+    out.resize(offset + length);
+    WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &out[offset], length, NULL, NULL);
+}
+
+inline void assignUtf8(std::string& out, std::wstring_view text) {
+    out.clear();
+    appendUtf8(out, text);
+}
+
+inline std::string toUtf8(std::wstring_view text) {
+    std::string result;
+    appendUtf8(result, text);
+    return result;
+}
+
+inline std::wstring fromUtf8(std::string_view text) {
+    std::wstring result;
+    if (text.empty()) return result;
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), NULL, 0);
+    if (length <= 0) return result;
+    result.resize(length);
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &result[0], length);
+    return result;
+}